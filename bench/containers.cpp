@@ -0,0 +1,94 @@
+/* container churn on libmem vs the default allocator */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+
+#include "mem_resource.hpp"
+
+static const int kRounds = 20;
+static const int kElems = 2000;
+
+template <typename F>
+static void run(const char* name, F f) {
+    auto start = std::chrono::steady_clock::now();
+    long check = 0;
+    for (int r = 0; r < kRounds; r++)
+        check += f(r);
+    auto usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("%-32s %10ld us  (check %ld)\n", name, (long)usec, check);
+}
+
+template <typename Vec>
+static long vector_churn(Vec v) {
+    for (int i = 0; i < kElems * 8; i++)
+        v.push_back(i);
+    long sum = 0;
+    while (!v.empty()) {
+        sum += v.back();
+        v.pop_back();
+        if (v.size() % 1024 == 0)
+            v.shrink_to_fit();
+    }
+    return sum;
+}
+
+template <typename Map>
+static long map_churn(Map m, int seed) {
+    for (int i = 0; i < kElems; i++)
+        m[(i * 7919 + seed) % (kElems * 4)] = i;
+    for (int i = 0; i < kElems; i += 2)
+        m.erase((i * 7919 + seed) % (kElems * 4));
+    for (int i = 0; i < kElems; i++)
+        m[(i * 104729 + seed) % (kElems * 4)] = i;
+    return (long)m.size();
+}
+
+int main() {
+    if (Mem_Init(16 * 1024 * 1024) != 0)
+        exit(1);
+    std::pmr::memory_resource* heap = mem::heap_resource();
+    std::pmr::memory_resource* dflt = std::pmr::new_delete_resource();
+
+    run("vector<int> std::allocator", [](int) {
+        return vector_churn(std::vector<int>());
+    });
+    run("vector<int> mem::allocator", [](int) {
+        return vector_churn(std::vector<int, mem::allocator<int> >());
+    });
+    run("pmr::vector<int> mem::resource", [heap](int) {
+        return vector_churn(std::pmr::vector<int>(heap));
+    });
+
+    run("map<int,int> std::allocator", [](int r) {
+        return map_churn(std::map<int, int>(), r);
+    });
+    run("map<int,int> mem::allocator", [](int r) {
+        typedef mem::allocator<std::pair<const int, int> > A;
+        return map_churn(std::map<int, int, std::less<int>, A>(), r);
+    });
+    run("pmr::map<int,int> new_delete", [dflt](int r) {
+        return map_churn(std::pmr::map<int, int>(dflt), r);
+    });
+    run("pmr::map<int,int> mem::resource", [heap](int r) {
+        return map_churn(std::pmr::map<int, int>(heap), r);
+    });
+
+    run("unordered_map std::allocator", [](int r) {
+        return map_churn(std::unordered_map<int, int>(), r);
+    });
+    run("unordered_map mem::allocator", [](int r) {
+        typedef mem::allocator<std::pair<const int, int> > A;
+        return map_churn(std::unordered_map<int, int, std::hash<int>,
+                         std::equal_to<int>, A>(), r);
+    });
+    run("pmr::unordered_map mem::resource", [heap](int r) {
+        return map_churn(std::pmr::unordered_map<int, int>(heap), r);
+    });
+
+    exit(0);
+}
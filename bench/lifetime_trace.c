@@ -0,0 +1,137 @@
+/*
+ * Trace-driven comparison of Mem_Alloc and Mem_Alloc_Hint
+ *
+ * A synthetic server trace: small long-lived cache entries arrive steadily
+ * while bursts of short-lived request buffers come and go around them.
+ * The same trace is replayed twice, each run in its own process since
+ * Mem_Init can only be called once:
+ *   plain  - every allocation through Mem_Alloc
+ *   hinted - Mem_Alloc_Hint with MEM_LIFETIME_SHORT / MEM_LIFETIME_LONG
+ * Reports the allocation success rate and the external fragmentation,
+ * 1 - largest free block / total free, sampled along the way.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define REGION      (256 * 1024)
+#define STEPS       20000
+#define MAX_LIVE    8192
+#define SAMPLE      500
+
+typedef struct live_obj {
+    void *ptr;
+    int blk;        // block size, header and padding included
+    int death;      // step at which the object is freed
+} live_obj;
+
+static live_obj live[MAX_LIVE];
+static int nlive;
+static unsigned int seed;
+
+static int next_rand(int n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % n;
+}
+
+/* Largest block Mem_Alloc can currently hand out, found by probing */
+static int largest_free(void) {
+    int lo = 0;
+    int hi = REGION;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        void *p = Mem_Alloc(mid);
+        if (p != NULL) {
+            Mem_Free(p);
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+static void run_trace(int hinted) {
+    int step, i;
+    int attempts = 0;
+    int failures = 0;
+    int busy = 0;
+    int samples = 0;
+    double frag_sum = 0;
+    double frag_max = 0;
+
+    seed = 42;
+    for (step = 0; step < STEPS; step++) {
+        // Retire everything whose time has come
+        for (i = 0; i < nlive; ) {
+            if (live[i].death <= step) {
+                Mem_Free(live[i].ptr);
+                busy -= live[i].blk;
+                live[i] = live[--nlive];
+            } else {
+                i++;
+            }
+        }
+
+        // One long-lived entry every few steps, a burst of buffers each step
+        int nshort = next_rand(4);
+        int want_long = next_rand(8) == 0;
+        for (i = 0; i < nshort + want_long && nlive < MAX_LIVE; i++) {
+            int is_long = i == nshort;
+            int size = is_long ? 32 + next_rand(256) : 512 + next_rand(15872);
+            int life = is_long ? 2000 + next_rand(4000) : 1 + next_rand(12);
+            void *p;
+
+            attempts++;
+            if (hinted)
+                p = Mem_Alloc_Hint(size, is_long ? MEM_LIFETIME_LONG :
+                                   MEM_LIFETIME_SHORT);
+            else
+                p = Mem_Alloc(size);
+            if (p == NULL) {
+                failures++;
+                continue;
+            }
+            live[nlive].ptr = p;
+            live[nlive].blk = (size + 4 + 7) / 8 * 8;
+            live[nlive].death = step + life;
+            busy += live[nlive].blk;
+            nlive++;
+        }
+
+        if (step % SAMPLE == SAMPLE - 1) {
+            int total_free = (REGION - 8) - busy;
+            int largest = largest_free();
+            double frag = 0;
+            if (total_free > 0 && largest > 0)
+                frag = 1.0 - (double)(largest + 4) / total_free;
+            frag_sum += frag;
+            if (frag > frag_max)
+                frag_max = frag;
+            samples++;
+        }
+    }
+
+    printf("%-7s attempts %7d  failed %6d  success %6.2f%%  "
+           "frag avg %5.3f max %5.3f\n", hinted ? "hinted" : "plain",
+           attempts, failures, 100.0 * (attempts - failures) / attempts,
+           frag_sum / samples, frag_max);
+    fflush(stdout);
+}
+
+int main() {
+    int hinted;
+    for (hinted = 0; hinted <= 1; hinted++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (Mem_Init(REGION) != 0)
+                exit(1);
+            run_trace(hinted);
+            exit(0);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    exit(0);
+}
@@ -4,8 +4,17 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#define MEM_NO_MALLOC_STUB
 #include "mem.h"
+#include "mem_core.h"
 
 /*
  * This structure serves as the header for each allocated and free block
@@ -26,7 +35,8 @@ typedef struct blk_hdr {
     * SLB = 0 => previous block is free
     * SLB = 1 => previous block is allocated/busy
     * 
-    * When used as the footer the last two bits should be zero
+    * When used as the footer the last two bits hold the trimming state
+    * of the free block (FTR_SEEN, FTR_TRIMMED), the size is the rest
     */
 
     /*
@@ -47,6 +57,17 @@ typedef struct blk_hdr {
     */
 } blk_hdr;
 
+/*
+ * Trimming state in the footer of a free block
+ * FTR_SEEN: a trimming pass has already found the block free
+ * FTR_TRIMMED: the whole pages inside it went back to the kernel
+ * A footer written for new free space has both clear, a free block that
+ * only shrinks keeps them.
+ */
+#define FTR_SEEN     1
+#define FTR_TRIMMED  2
+#define FTR_BITS     3
+
 /* Global variable - This will always point to the first block
  * i.e. the block with the lowest address */
 blk_hdr *first_blk = NULL;
@@ -54,9 +75,339 @@ blk_hdr *first_blk = NULL;
 /*
  * Note: 
  *  The end of the available memory can be determined using end_mark
- *  The size_status of end_mark has a value of 1
+ *  The size_status of end_mark has a value of 1, plus 2 when the last
+ *  block is busy - compare against end_mark itself to stop a walk
  *
  */
+blk_hdr *end_mark = NULL;
+
+/*
+ * Handle table for relocatable allocations
+ * A handle-backed block keeps its handle number in the first word of its
+ * payload, the caller's data starts 8 bytes further in (to stay 8 byte
+ * aligned). A busy block is movable only if that word names a slot
+ * pointing back at the block and the slot holds no locks.
+ * Released slots are chained through next_free, slots from handles_used
+ * on have never been handed out, so Mem_Handle_Alloc takes O(1).
+ */
+#define HANDLE_OVERHEAD 8
+
+typedef struct handle_slot {
+    blk_hdr *blk;   // header of the backing block, NULL if slot unused
+    int locks;      // nesting count of Mem_Handle_Lock
+    int next_free;  // next released slot, -1 at the end of the chain
+} handle_slot;
+
+static handle_slot handles[MEM_MAX_HANDLES];
+static int handles_used = 0;
+static int handle_free_head = -1;
+
+/*
+ * Compaction resumes from this block on the next Mem_Compact call
+ * NULL means start over from first_blk. When the headers around it are
+ * rewritten it moves on to the first block at or after its old position
+ * (see blk_changed), so the pass keeps going under heap traffic.
+ */
+static blk_hdr *compact_cursor = NULL;
+
+/* Number of headers Mem_Compact visits between budget checks */
+#define COMPACT_STEP_BLKS 64
+
+/*
+ * Locking
+ * The heap is single threaded until the background worker starts, from
+ * then on every entry point takes heap_lock. The worker only holds it for
+ * one bounded step at a time.
+ */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static int locking = 0;
+
+#define LOCK()   do { if (locking) pthread_mutex_lock(&heap_lock); } while (0)
+#define UNLOCK() do { if (locking) pthread_mutex_unlock(&heap_lock); } while (0)
+
+/* Bumped whenever block headers change, lets the worker go idle */
+static unsigned int heap_gen = 0;
+
+/* Next block to look at for page trimming, NULL to start over */
+static blk_hdr *trim_cursor = NULL;
+/* Set when the current trimming pass left blocks for the next one */
+static int trim_pending = 0;
+/* Where trimming of the block at trim_cursor resumes, 0 for its start */
+static unsigned long trim_resume = 0;
+
+/* Pages handed back per trimming step at most */
+#define TRIM_STEP_PAGES 64
+static int page_size = 0;
+
+/* Size of a block without the two status bits */
+static int blk_size(blk_hdr *blk) {
+    return blk->size_status - (blk->size_status & 3);
+}
+
+/* Header of the block following blk */
+static blk_hdr* blk_next(blk_hdr *blk) {
+    return (blk_hdr*)((char*)blk + blk_size(blk));
+}
+
+/*
+ * Optional side table (MEM_SIDE_TABLE)
+ * Two parallel arrays with one entry per block, in address order: the
+ * offset of the block from first_blk and its size with the busy bit (the
+ * prev bit is dropped). The best fit search in Mem_Alloc scans st_size
+ * only, so it reads contiguous memory instead of hopping from header to
+ * header and never touches payload memory.
+ */
+static int *st_off = NULL;
+static int *st_size = NULL;
+static int st_count = 0;
+
+/* Index of the first entry whose block starts at or after offset */
+static int st_lower(int offset) {
+    int lo = 0;
+    int hi = st_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (st_off[mid] < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Rewrites the entries covering [from, to) from the block headers */
+static void st_sync(blk_hdr *from, blk_hdr *to) {
+    int lo = st_lower((char*)from - (char*)first_blk);
+    int hi = st_lower((char*)to - (char*)first_blk);
+    int n = 0;
+    blk_hdr *blk;
+
+    for (blk = from; blk != to; blk = blk_next(blk))
+        n++;
+    if (n != hi - lo) {
+        memmove(st_off + lo + n, st_off + hi, (st_count - hi) * sizeof(int));
+        memmove(st_size + lo + n, st_size + hi, (st_count - hi) * sizeof(int));
+        st_count += n - (hi - lo);
+    }
+    for (blk = from; blk != to; blk = blk_next(blk), lo++) {
+        st_off[lo] = (char*)blk - (char*)first_blk;
+        st_size[lo] = blk->size_status & ~2;
+    }
+}
+
+/* Smallest free size >= need in v[0..n), INT_MAX if there is none */
+static int st_min_scalar(const int *v, int n, int need) {
+    int best = INT_MAX;
+    int i;
+    for (i = 0; i < n; i++)
+        if ((v[i] & 1) == 0 && v[i] >= need && v[i] < best)
+            best = v[i];
+    return best;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+/*
+ * Vector versions of st_min_scalar, picked at Mem_Init time
+ * Busy entries (odd) and entries below need are replaced by INT_MAX
+ * before taking the lane-wise minimum.
+ */
+__attribute__((target("avx2")))
+static int st_min_avx2(const int *v, int n, int need) {
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i below = _mm256_set1_epi32(need - 1);
+    __m256i none = _mm256_set1_epi32(INT_MAX);
+    __m256i best = none;
+    int lanes[8];
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(v + i));
+        __m256i skip = _mm256_or_si256(
+            _mm256_cmpeq_epi32(_mm256_and_si256(x, one), one),
+            _mm256_cmpgt_epi32(below, x));
+        best = _mm256_min_epi32(best, _mm256_blendv_epi8(x, none, skip));
+    }
+    _mm256_storeu_si256((__m256i*)lanes, best);
+
+    int min = st_min_scalar(v + i, n - i, need);
+    for (i = 0; i < 8; i++)
+        if (lanes[i] < min)
+            min = lanes[i];
+    return min;
+}
+
+__attribute__((target("sse4.1")))
+static int st_min_sse41(const int *v, int n, int need) {
+    __m128i one = _mm_set1_epi32(1);
+    __m128i below = _mm_set1_epi32(need - 1);
+    __m128i none = _mm_set1_epi32(INT_MAX);
+    __m128i best = none;
+    int lanes[4];
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(v + i));
+        __m128i skip = _mm_or_si128(
+            _mm_cmpeq_epi32(_mm_and_si128(x, one), one),
+            _mm_cmpgt_epi32(below, x));
+        best = _mm_min_epi32(best, _mm_blendv_epi8(x, none, skip));
+    }
+    _mm_storeu_si128((__m128i*)lanes, best);
+
+    int min = st_min_scalar(v + i, n - i, need);
+    for (i = 0; i < 4; i++)
+        if (lanes[i] < min)
+            min = lanes[i];
+    return min;
+}
+#endif
+
+static int (*st_min)(const int *v, int n, int need) = st_min_scalar;
+
+/*
+ * Best fit lookup in the side table
+ * Picks the same block as core_find: the first exact fit, otherwise the
+ * last of the smallest blocks that are large enough
+ */
+static blk_hdr* st_best(int size) {
+    int best = st_min(st_size, st_count, size);
+    int i;
+
+    if (best == INT_MAX)
+        return NULL;
+    if (best == size) {
+        for (i = 0; st_size[i] != best; i++)
+            ;
+    } else {
+        for (i = st_count - 1; st_size[i] != best; i--)
+            ;
+    }
+    return (blk_hdr*)((char*)first_blk + st_off[i]);
+}
+
+/*
+ * Optional block-start bitmap (MEM_HARDENED)
+ * One bit per 8 byte granule from first_blk on, set where a block header
+ * starts. Headers always sit at a multiple of 8 from first_blk, so a
+ * pointer can be checked against the bitmap in constant time before its
+ * header is trusted.
+ * Bits inside a block are always clear, so keeping the bitmap current
+ * only touches the headers that appear or go away: blk_changed sets the
+ * bits of the headers it is given, code that merges blocks drops the
+ * bits of the headers it swallows.
+ */
+static unsigned int *bm = NULL;
+
+static int bm_index(blk_hdr *blk) {
+    return ((char*)blk - (char*)first_blk) / 8;
+}
+
+static int bm_test(int i) {
+    return (bm[i / 32] >> (i % 32)) & 1;
+}
+
+/* Forgets the block start at blk, which is being merged away */
+static void bm_drop(blk_hdr *blk) {
+    if (bm != NULL)
+        bm[bm_index(blk) / 32] &= ~(1u << (bm_index(blk) % 32));
+}
+
+/* Marks the block starts in [from, to) */
+static void bm_sync(blk_hdr *from, blk_hdr *to) {
+    blk_hdr *blk;
+    for (blk = from; blk != to; blk = blk_next(blk))
+        bm[bm_index(blk) / 32] |= 1u << (bm_index(blk) % 32);
+}
+
+/*
+ * Moves a pass cursor that pointed into (from, to), whose headers were
+ * just rewritten, to the first block at or after its old position
+ */
+static blk_hdr* cursor_resync(blk_hdr *cursor, blk_hdr *from, blk_hdr *to) {
+    if (cursor == NULL || cursor <= from || cursor >= to)
+        return cursor;
+    while (from < cursor)
+        from = blk_next(from);
+    return from;
+}
+
+/*
+ * Called after the headers of the blocks in [from, to) have been rewritten
+ * Keeps the out-of-band block metadata and the pass cursors in step with
+ * the heap
+ */
+static void blk_changed(blk_hdr *from, blk_hdr *to) {
+    if (st_off != NULL)
+        st_sync(from, to);
+    if (bm != NULL)
+        bm_sync(from, to);
+    heap_gen++;
+    compact_cursor = cursor_resync(compact_cursor, from, to);
+    //**A rewritten block is trimmed from its start again.**
+    if (trim_cursor >= from && trim_cursor < to)
+        trim_resume = 0;
+    trim_cursor = cursor_resync(trim_cursor, from, to);
+}
+
+/*
+ * Allocation, splitting and coalescing are done by the mem_core.h
+ * primitives (mem::heap from mem_core.hpp), which report every block
+ * they rewrite or merge away through these two
+ */
+void mem_blk_changed(blk_hdr *from, blk_hdr *to) {
+    blk_changed(from, to);
+}
+
+void mem_blk_dropped(blk_hdr *blk) {
+    bm_drop(blk);
+}
+
+/* Frees a single busy block, returns the coalesced free block */
+static blk_hdr* free_blk(blk_hdr *blk) {
+	return core_free_span(blk, blk_next(blk));
+}
+
+/* Largest request whose header and padding still fit in an int */
+#define MAX_REQUEST (INT_MAX - 11)
+
+/*
+ * Block size for a request of 'size' payload bytes
+ * Adds 4 bytes for the header and rounds up to a multiple of 8
+ * Returns -1 if size is not positive or too large for a block
+ */
+static int pad_size(int size) {
+	if (size <= 0 || size > MAX_REQUEST)
+		return -1;
+	return core_block_size(size);
+}
+
+/*
+ * Lowest (last == 0) or highest (last != 0) free block of at least size
+ * bytes, NULL if none fits
+ */
+static blk_hdr* find_fit(int size, int last) {
+	blk_hdr *found = NULL;
+	int i;
+
+	if (st_off != NULL) { //Scan the side table instead of the heap.
+		for (i = 0; i < st_count; i++) {
+			int idx = last ? st_count - 1 - i : i;
+			if ((st_size[idx] & 1) == 0 && st_size[idx] >= size)
+				return (blk_hdr*)((char*)first_blk + st_off[idx]);
+		}
+		return NULL;
+	}
+
+	blk_hdr *memptr;
+	for (memptr = first_blk; memptr != end_mark; memptr = blk_next(memptr)) {
+		if ((memptr->size_status & 1) == 0 && blk_size(memptr) >= size) {
+			found = memptr;
+			if (!last)
+				break;
+		}
+	}
+	return found;
+}
 
 /* 
  * Function for allocating 'size' bytes
@@ -69,67 +420,89 @@ blk_hdr *first_blk = NULL;
  * - Also, when allocating a block - split it into two blocks
  * Tips: Be careful with pointer arithmetic 
  */
-void* Mem_Alloc(int size) {                      
-	if (size <= 0) //Request of invalid amount of memory, return null.
+static void* mem_alloc(int size) {
+	size = pad_size(size);
+	if (size < 0) //Request of invalid amount of memory, return null.
 		return NULL;  
-	size += 4;     //Add 4 bytes for header to requested size.
-
-	//**Padding**
-	if (size % 8 != 0) {  
-  		int difference; 
-		if (size < 8) { //size is less than 8. 
-			difference = 8 - size;
-			size += difference;
-		} 
-		else { 		//size is > 8.
-			difference = size / 8;
-			int multiple = 8  * (difference + 1);
-			size += (multiple - size); 
-		}
-	}
-	
-	//**Traversing heap to find best-fitting block to allocate for requested size**
-	blk_hdr* memptr = first_blk;		 //memptr points to start of payload of 1st block.
-	blk_hdr* best = NULL; 
-	while (memptr->size_status != 1) { 
-		int curr = memptr->size_status;  //Reinit curr to the next block's size.
-		int currsize = curr - (curr & 3);//The size of every traversed block.
-		if ((curr & 1) == 0 && currsize >= size) {  //If the block is free then we can choose optimal fit.
-			if (currsize == size) {  //If we have an exact fit, break loop and allocate best block.
-				best = memptr; 	 //best points to the potential best-fitting block.
-				break;
-			}
-			if ( best == NULL || currsize <= best->size_status - (best->size_status & 3)) 
-				best = memptr;		//Found new best-fit block.	
-		}
-	
-		memptr = (blk_hdr*)((char*)(memptr) + currsize); //Go to next block.
-	}
+
+	//**Finding the best-fitting block to allocate for requested size**
+	blk_hdr* best = st_off ? st_best(size) : core_find(size); 
 	//**If a big enough block was never found in heap, return NULL.**
 	if (best == NULL) 
 		return NULL;
 	
- 	//**Actual size of found available block.**
-	int bestsize = best->size_status - (best->size_status & 3); 
-	
-	//**Allocating the block of best fit recently found.**
-	blk_hdr *pload = (blk_hdr*)((char*)(best) + 4); //Pointer to start of payload of alloc'd block.
-	if ((bestsize - size) >= 8) {	     //Split if there will be enough free space for a 2nd block.
-		best->size_status = size + (best->size_status & 3) + 1;
-		
-		blk_hdr *freeHdr = (blk_hdr*)((char*)(best) + size);  //Move pointer to free block. 
-		freeHdr->size_status = (bestsize-size) + 2;     //Update free block header.
-			
-		blk_hdr* freeFtr = (blk_hdr*)((char*)(best) + (bestsize-4));		
-		freeFtr->size_status = bestsize - size;		//Update free block footer.
+	return core_carve(best, size, 1);
+}
+
+void* Mem_Alloc(int size) {
+	LOCK();
+	void *ptr = mem_alloc(size);
+	UNLOCK();
+	return ptr;
+}
+
+/*
+ * Function for allocating 'size' bytes with a lifetime hint
+ * Returns address of allocated block on success
+ * Returns NULL on failure
+ * - MEM_LIFETIME_SHORT: lowest free block that fits, carved from its low end
+ * - MEM_LIFETIME_LONG: highest free block that fits, carved from its high end
+ * - MEM_LIFETIME_DEFAULT: same as Mem_Alloc
+ * Keeping the two classes at opposite ends of the region stops long-lived
+ * blocks from pinning the holes that short-lived ones leave behind
+ */
+static void* mem_alloc_hint(int size, int lifetime_class) {
+	if (lifetime_class == MEM_LIFETIME_DEFAULT)
+		return mem_alloc(size);
+	if (lifetime_class != MEM_LIFETIME_SHORT && lifetime_class != MEM_LIFETIME_LONG)
+		return NULL;
+	size = pad_size(size);
+	if (size < 0) 
+		return NULL;
+
+	blk_hdr *blk = find_fit(size, lifetime_class == MEM_LIFETIME_LONG);
+	if (blk == NULL)
+		return NULL;
+	if (lifetime_class == MEM_LIFETIME_LONG)
+		return core_place_high(blk, size);
+	return core_carve(blk, size, 1);
+}
+
+void* Mem_Alloc_Hint(int size, int lifetime_class) {
+	LOCK();
+	void *ptr = mem_alloc_hint(size, lifetime_class);
+	UNLOCK();
+	return ptr;
+}
+
+/*
+ * Header of the busy block whose payload starts at ptr
+ * Returns NULL if ptr is NULL, not 8 byte aligned, outside the heap or
+ * already free, and in hardened mode if ptr is not the start of a block
+ */
+static blk_hdr* busy_hdr(void *ptr) {
+	//**If either ptr is null or ptr isn't multiple 8, return NULL.**
+	if (!ptr || ((unsigned long)ptr) % 8 != 0) 
+		return NULL;
+	//**Casting ptr to blk_hdr to access its header.**
+	blk_hdr *hdr = (blk_hdr *)ptr;
+	//**If ptr is before heap/out of bounds, return NULL. 
+	if (hdr < first_blk)  { //Before heap/out of bounds.
+		printf("Out of bounds leftwise in memfree\n");
+		return NULL;
 	}
-	else { //If we cannot split, update header accordingly.
-		best->size_status += 1;
-		blk_hdr * nextblk = (blk_hdr*)((char*)(best) + bestsize);
-		nextblk->size_status += 2; //Update header of next block.
-	}	
+
+	hdr = (blk_hdr*)((char*)(hdr) - 4); //Going to header.
+	if (hdr >= end_mark) //Past the last block.
+		return NULL;
+	//**Hardened: interior and stale pointers have no block start bit.**
+	if (bm != NULL && !bm_test(bm_index(hdr)))
+		return NULL;
 	
-	return (void *)pload;
+	//**If ptr is already freed, return NULL.**
+	if ((hdr->size_status & 1) == 0) 
+		return NULL;
+	return hdr;
 }
 
 /* 
@@ -143,105 +516,538 @@ void* Mem_Alloc(int size) {
  * - Mark the block as free 
  * - Coalesce if one or both of the immediate neighbours are free 
  */
-int Mem_Free(void *ptr) {                        
-	//**If either ptr is null or ptr isn't multiple 8, return -1.**
-	if (!ptr || ((int)ptr) % 8 != 0) 
+static int mem_free(void *ptr) {
+	blk_hdr *freeme = busy_hdr(ptr);
+	if (freeme == NULL) 
 		return -1;
-	//**Casting ptr to blk_hdr to access its header.**
-	blk_hdr *freeme = (blk_hdr *)ptr;
-	//**If ptr is before heap/out of bounds, return -1. 
-	if (freeme < first_blk)  { //Before heap/out of bounds, return -1.
-		printf("Out of bounds leftwise in memfree\n");
+	
+	free_blk(freeme);
+
+	//**If coalescing works &/or we freed pointer by request, return 0.**
+	return 0;
+}
+
+int Mem_Free(void *ptr) {
+	LOCK();
+	int rc = mem_free(ptr);
+	UNLOCK();
+	return rc;
+}
+
+/*
+ * Function for freeing a block whose requested size the caller knows
+ * Arguments - ptr: address returned by Mem_Alloc or Mem_Alloc_Hint,
+ *             size: the size that was asked for (or anything that pads
+ *             to the same block, up to Mem_Usable_Size)
+ * Returns 0 on success, -1 on failure, also when size pads to a block
+ * size other than the one in the header
+ */
+static int mem_free_sized(void *ptr, int size) {
+	int blksize = pad_size(size);
+	if (blksize < 0)
+		return -1;
+	blk_hdr *freeme = busy_hdr(ptr);
+	if (freeme == NULL) 
+		return -1;
+	if (blksize != blk_size(freeme)) //Would free too much or too little.
+		return -1;
+
+	core_free_span(freeme, (blk_hdr*)((char*)freeme + blksize));
+	return 0;
+}
+
+int Mem_Free_Sized(void *ptr, int size) {
+	LOCK();
+	int rc = mem_free_sized(ptr, size);
+	UNLOCK();
+	return rc;
+}
+
+/*
+ * Function for querying the payload capacity of a busy block
+ * Returns the number of bytes usable at ptr, at least the size passed to
+ * Mem_Alloc since the block was padded to a multiple of 8
+ * Returns -1 if ptr is not a busy block (see Mem_Free)
+ */
+static int mem_usable_size(void *ptr) {
+	blk_hdr *hdr = busy_hdr(ptr);
+	if (hdr == NULL)
 		return -1;
+	return blk_size(hdr) - 4;
+}
+
+int Mem_Usable_Size(void *ptr) {
+	LOCK();
+	int rc = mem_usable_size(ptr);
+	UNLOCK();
+	return rc;
+}
+
+/* Orders pointers by address for Mem_Free_Batch */
+static int cmp_addr(const void *a, const void *b) {
+	char *pa = *(char**)a;
+	char *pb = *(char**)b;
+	return (pa > pb) - (pa < pb);
+}
+
+/*
+ * Function for freeing n blocks in one go
+ * Arguments - ptrs: addresses to free (sorted in place), n: how many
+ * Returns 0 if every pointer was freed
+ * Returns -1 if any pointer was rejected as Mem_Free would (the others
+ *         are still freed)
+ * Pointers are sorted by address. Runs of adjacent blocks are then freed
+ * as one span, so each run gets one coalescing step instead of one per
+ * block.
+ */
+static int mem_free_batch(void **ptrs, int n) {
+	int rc = 0;
+	int i = 0;
+
+	if (ptrs == NULL || n < 0)
+		return -1;
+	qsort(ptrs, n, sizeof(void*), cmp_addr);
+
+	while (i < n) {
+		blk_hdr *start = NULL;
+		//**Duplicates would be freed twice, reject the repeats.**
+		if (i == 0 || ptrs[i] != ptrs[i - 1])
+			start = busy_hdr(ptrs[i]);
+		i++;
+		if (start == NULL) {
+			rc = -1;
+			continue;
+		}
+
+		//**Extending the run while the next pointer is the next block.**
+		blk_hdr *end = blk_next(start);
+		while (i < n && end != end_mark && ptrs[i] == (char*)end + 4 && 
+		       (end->size_status & 1)) {
+			end = blk_next(end);
+			i++;
+		}
+		core_free_span(start, end);
 	}
+	return rc;
+}
 
-	freeme = (blk_hdr*)((char*)(freeme) - 4); //Going to header.
-	
-	//**If ptr is already freed, return -1.**
-	if ((freeme->size_status & 1) == 0) 
+int Mem_Free_Batch(void **ptrs, int n) {
+	LOCK();
+	int rc = mem_free_batch(ptrs, n);
+	UNLOCK();
+	return rc;
+}
+
+/*
+ * Function for allocating n blocks of 'size' bytes in one go
+ * Arguments - size: bytes per block, n: number of blocks, out: receives
+ *             the n addresses
+ * Returns 0 on success, -1 on failure (nothing is allocated then)
+ * The blocks are carved out of one free block when one is large enough,
+ * so a single search serves all of them and they end up adjacent.
+ * Otherwise each block is allocated on its own.
+ */
+static int mem_alloc_batch(int size, int n, void **out) {
+	if (n <= 0 || out == NULL)
 		return -1;
-	
-	blk_hdr *newfoot = freeme;	  
-	freeme->size_status -= 1;  	  //Declaring the block as free.
-	
-	//**Making a footer for newly freed block.**
-	int freePayload = freeme->size_status - (freeme->size_status & 3);
-	newfoot = (blk_hdr*)((char*)(newfoot) + freePayload - 4);
-	newfoot->size_status = freePayload;	
-
-	//**Coalescing free blocks in heap.**
-	switch (freeme->size_status & 3) {
-		case 0: //Previous block is free, coalesce with freeme.
-			freeme = (blk_hdr*)((char*)(freeme) + 4); 
-			
-			//**Move to footer of previous block (free).**
-			blk_hdr *prevblk = (blk_hdr*)((char*)(freeme) - 8); 
-			blk_hdr *footer = prevblk; 
-			prevblk = (blk_hdr*)((char*)(prevblk) - (footer->size_status)+4);
-			
-			//**Updating header after coalescing.**
-			footer = (blk_hdr*)((char*)(footer) + 4);
-			prevblk->size_status += freePayload;
-			
-			//**Making/updating footer of newly coalesced block.**
-			footer = (blk_hdr*)((char*)(footer) + freePayload-4);
-			footer->size_status = prevblk->size_status - (prevblk->size_status&3);
-			
-			//**Going to header of next block.**
-			blk_hdr *nextblk = freeme; 				    
-			nextblk = (blk_hdr*)((char*)(nextblk) + freePayload-4);
-
-			//**Update nextblk header, check if it's free.**
-			nextblk->size_status -= 2; 
-			if ((nextblk->size_status & 1) == 0) { 
-				//**Go to footer of next block and update it.**
-				nextblk = (blk_hdr*)((char*)(nextblk) + (nextblk->size_status)-4);
-				nextblk->size_status += footer->size_status;
-				//**Updating header of coalesced blk.**
-				prevblk->size_status = nextblk->size_status + (prevblk->size_status&3); 
+	size = pad_size(size); //Rejects sizes that would overflow once padded.
+	if (size < 0 || n > INT_MAX / size)
+		return -1;
+	int total = size * n;
+	int i;
+
+	blk_hdr *best = st_off ? st_best(total) : core_find(total);
+	if (best == NULL) { //No room for all of them in one block.
+		for (i = 0; i < n; i++) {
+			out[i] = mem_alloc(size - 4);
+			if (out[i] == NULL) {
+				mem_free_batch(out, i);
+				return -1;
 			}
+		}
+		return 0;
+	}
+
+	//**Carving n busy blocks from the front of best.**
+	char *pload = core_carve(best, size, n);
+	for (i = 0; i < n; i++)
+		out[i] = pload + i * size;
+	return 0;
+}
+
+int Mem_Alloc_Batch(int size, int n, void **out) {
+	LOCK();
+	int rc = mem_alloc_batch(size, n, out);
+	UNLOCK();
+	return rc;
+}
+
+/*
+ * Function for allocating a relocatable block of 'size' bytes
+ * Returns a handle (>= 0) on success
+ * Returns -1 on failure, also once MEM_MAX_HANDLES handles are live
+ * The block may be moved by Mem_Compact whenever it is not locked, so the
+ * address is only valid between Mem_Handle_Lock and Mem_Handle_Unlock
+ */
+static int mem_handle_alloc(int size) {
+	if (size <= 0 || size > MAX_REQUEST - HANDLE_OVERHEAD) //Room for the handle word.
+		return -1;
+
+	int h = handle_free_head;
+	if (h < 0 && handles_used == MEM_MAX_HANDLES) //Handle table is full.
+		return -1;
+
+	int *pload = (int*)mem_alloc(size + HANDLE_OVERHEAD);
+	if (pload == NULL)
+		return -1;
+	
+	//**Reusing a released slot first, then a fresh one.**
+	if (h >= 0)
+		handle_free_head = handles[h].next_free;
+	else
+		h = handles_used++;
+	*pload = h; //Back-reference used by Mem_Compact.
+	handles[h].blk = (blk_hdr*)((char*)pload - 4);
+	handles[h].locks = 0;
+	return h;
+}
+
+int Mem_Handle_Alloc(int size) {
+	LOCK();
+	int rc = mem_handle_alloc(size);
+	UNLOCK();
+	return rc;
+}
+
+/* 
+ * Function for pinning a handle's block in place
+ * Returns the address of the data on success, NULL for a bad handle
+ * Locks nest, every lock needs a matching Mem_Handle_Unlock
+ */
+static void* mem_handle_lock(int h) {
+	if (h < 0 || h >= MEM_MAX_HANDLES || handles[h].blk == NULL)
+		return NULL;
+	handles[h].locks++;
+	return (char*)handles[h].blk + 4 + HANDLE_OVERHEAD;
+}
+
+void* Mem_Handle_Lock(int h) {
+	LOCK();
+	void *ptr = mem_handle_lock(h);
+	UNLOCK();
+	return ptr;
+}
+
+/* 
+ * Function for releasing one lock on a handle
+ * Returns 0 on success, -1 for a bad or unlocked handle
+ */
+static int mem_handle_unlock(int h) {
+	if (h < 0 || h >= MEM_MAX_HANDLES || handles[h].blk == NULL)
+		return -1;
+	if (handles[h].locks == 0)
+		return -1;
+	handles[h].locks--;
+	return 0;
+}
+
+int Mem_Handle_Unlock(int h) {
+	LOCK();
+	int rc = mem_handle_unlock(h);
+	UNLOCK();
+	return rc;
+}
+
+/* 
+ * Function for freeing a handle and its block
+ * Returns 0 on success, -1 for a bad or still locked handle
+ */
+static int mem_handle_free(int h) {
+	if (h < 0 || h >= MEM_MAX_HANDLES || handles[h].blk == NULL)
+		return -1;
+	if (handles[h].locks != 0)
+		return -1;
+	if (mem_free((char*)handles[h].blk + 4) != 0)
+		return -1;
+	handles[h].blk = NULL;
+	handles[h].next_free = handle_free_head;
+	handle_free_head = h;
+	return 0;
+}
+
+int Mem_Handle_Free(int h) {
+	LOCK();
+	int rc = mem_handle_free(h);
+	UNLOCK();
+	return rc;
+}
+
+/* 
+ * Returns the handle backing blk if blk can be moved, -1 otherwise
+ */
+static int movable_handle(blk_hdr *blk) {
+	int h = *(int*)((char*)blk + 4);
+	if (h < 0 || h >= MEM_MAX_HANDLES)
+		return -1;
+	if (handles[h].blk != blk || handles[h].locks != 0)
+		return -1;
+	return h;
+}
+
+/*
+ * One bounded unit of compaction work
+ * Visits at most COMPACT_STEP_BLKS headers or slides one block of at most
+ * MEM_COMPACT_MAX_MOVE bytes down; larger blocks count as immovable
+ * Returns 1 if the pass should continue, 0 once it reached end_mark
+ */
+static int compact_step() {
+	blk_hdr *freeblk = compact_cursor ? compact_cursor : first_blk;
+	int visited;
+
+	for (visited = 0; visited < COMPACT_STEP_BLKS; visited++) {
+		if (freeblk == end_mark) {
+			compact_cursor = NULL;
+			return 0;
+		}
+		blk_hdr *busy = blk_next(freeblk);
+		int h;
+		//**Looking for a free block followed by an unlocked handle block.**
+		if ((freeblk->size_status & 1) || busy == end_mark || 
+		    blk_size(busy) > MEM_COMPACT_MAX_MOVE ||
+		    (h = movable_handle(busy)) < 0) {
+			freeblk = busy;
+			continue;
+		}
+
+		int freesize = blk_size(freeblk);
+		int busysize = blk_size(busy);
+		int prevbit = freeblk->size_status & 2;
+		blk_hdr *after = blk_next(busy);
+
+		//**Slide the busy block down over the free one.**
+		bm_drop(busy);
+		memmove(freeblk, busy, busysize);
+		freeblk->size_status = busysize + prevbit + 1;
+		handles[h].blk = freeblk;
+		blk_changed(freeblk, (blk_hdr*)((char*)freeblk + busysize));
+
+		//**The space left behind is freed like a busy block, it merges with the next free block.**
+		blk_hdr *hole = (blk_hdr*)((char*)freeblk + busysize);
+		hole->size_status = freesize + 2 + 1;
+		compact_cursor = core_free_span(hole, after);
+		return 1;
+	}
+
+	compact_cursor = freeblk;
+	return 1;
+}
+
+/*
+ * Function for sliding unlocked handle blocks toward first_blk so that
+ * their free neighbours merge into larger blocks
+ * Argument - budget_usec: time budget for this call, <= 0 for no limit
+ * Returns 0 when a full pass over the heap has completed
+ * Returns 1 when the budget ran out, call again to continue the pass
+ * Returns -1 if the heap is not initialized
+ */
+int Mem_Compact(int budget_usec) {
+	struct timespec start, now;
+
+	if (first_blk == NULL)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (;;) {
+		LOCK(); //Held for one step only, other threads get in between.
+		int more = compact_step();
+		UNLOCK();
+		if (!more)
 			break;
-		case 2: //Previous block is alloc'd, check if next block free.
-			freeme = (blk_hdr*)((char*)(freeme) + 4); 
-			//**Go to header of next block.**
-			blk_hdr *newnext = (blk_hdr*)((char*)(freeme) + freePayload - 4);
-			
-			//**Making footer for current-free block.**
-			blk_hdr *currhead = (blk_hdr*)((char*)(freeme) + freePayload - 8);
-			currhead->size_status = freePayload;
-
-			newnext->size_status -= 2; //The previous blk is free.
-			//**Check if next is free.**
-			if ((newnext->size_status & 1) == 0) { 
-				//**Accessing header of free next block.**
-				newnext = (blk_hdr*)((char*)(newnext) + (newnext->size_status)-4);
-				newnext->size_status += freePayload; 
-			
-				//**Updating bigger size of freeme header.**
-				freeme = (blk_hdr*)((char*)(freeme) - 4);
-				freeme->size_status = newnext->size_status + (freeme->size_status&3); 
+		if (budget_usec <= 0)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long elapsed = (now.tv_sec - start.tv_sec) * 1000000L + 
+		               (now.tv_nsec - start.tv_nsec) / 1000;
+		if (elapsed >= budget_usec)
+			return 1;
+	}
+	return 0;
+}
+
+
+/*
+ * Background maintenance (MEM_BACKGROUND)
+ * A worker thread wakes up every maint_period_ms and spends at most
+ * maint_budget_us on upkeep, one short locked step at a time:
+ * - a compaction pass (see Mem_Compact)
+ * - a trimming pass handing the whole pages inside free blocks back to
+ *   the kernel; they read back as zeros when reused
+ * Once both passes complete it idles until the heap changes again.
+ * A free block is only trimmed by the second pass that finds it (so
+ * blocks that are reused right away keep their pages) and only once, its
+ * footer records that it has been done.
+ */
+static pthread_t maint_thread;
+static pthread_mutex_t maint_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t maint_cond = PTHREAD_COND_INITIALIZER;
+static int maint_running = 0;
+static int maint_period_ms = 10;
+static int maint_budget_us = 1000;
+
+/*
+ * Gives back the pages inside free blocks, visiting a bounded number of
+ * blocks per call and making at most one madvise call of at most
+ * TRIM_STEP_PAGES pages; a larger block is trimmed over several calls
+ * Returns 1 if the pass should continue, 0 once it reached end_mark
+ */
+static int trim_step() {
+	blk_hdr *blk = trim_cursor;
+	int visited;
+
+	if (blk == NULL) { //New pass.
+		blk = first_blk;
+		trim_pending = 0;
+	}
+	for (visited = 0; visited < COMPACT_STEP_BLKS; visited++) {
+		if (blk == end_mark) {
+			trim_cursor = NULL;
+			return 0;
+		}
+		if ((blk->size_status & 1) == 0) {
+			//**Only pages strictly between header and footer.**
+			blk_hdr *footer = (blk_hdr*)((char*)blk + blk_size(blk) - 4);
+			unsigned long lo = ((unsigned long)blk + 4 + page_size - 1) & ~(unsigned long)(page_size - 1);
+			unsigned long hi = (unsigned long)footer & ~(unsigned long)(page_size - 1);
+			if (hi <= lo || (footer->size_status & FTR_TRIMMED))
+				; //Nothing (left) to give back.
+			else if ((footer->size_status & FTR_SEEN) == 0) {
+				footer->size_status |= FTR_SEEN; //Trimmed next pass if still free.
+				trim_pending = 1;
+			}
+			else {
+				if (trim_resume > lo && trim_resume < hi)
+					lo = trim_resume;
+				unsigned long end = lo + TRIM_STEP_PAGES * (unsigned long)page_size;
+				if (end < hi) { //Rest of the block in a later step.
+					madvise((void*)lo, end - lo, MADV_DONTNEED);
+					trim_resume = end;
+					trim_cursor = blk;
+					return 1;
+				}
+				madvise((void*)lo, hi - lo, MADV_DONTNEED);
+				footer->size_status |= FTR_TRIMMED;
+				trim_resume = 0;
+				trim_cursor = blk_next(blk);
+				return 1;
 			}
+		}
+		blk = blk_next(blk);
+	}
+	trim_cursor = blk;
+	return 1;
+}
+
+static long usec_since(struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000L + 
+	       (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void* maint_main(void *arg) {
+	unsigned int idle_gen = heap_gen - 1; //Force a first pass.
+	int phase = 0; //0 = compacting, 1 = trimming, 2 = done
+	(void)arg;
+
+	pthread_mutex_lock(&maint_mutex);
+	while (maint_running) {
+		struct timespec wake;
+		clock_gettime(CLOCK_REALTIME, &wake);
+		wake.tv_nsec += (long)maint_period_ms * 1000000L;
+		wake.tv_sec += wake.tv_nsec / 1000000000L;
+		wake.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&maint_cond, &maint_mutex, &wake);
+		if (!maint_running)
 			break;
+		int budget = maint_budget_us;
+		pthread_mutex_unlock(&maint_mutex);
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		do {
+			LOCK();
+			if (phase == 2 && (heap_gen != idle_gen || trim_pending))
+				phase = 0; //Heap changed or blocks wait for a second look.
+			if (phase == 0 && !compact_step())
+				phase = 1;
+			else if (phase == 1 && !trim_step()) {
+				phase = 2;
+				idle_gen = heap_gen;
+			}
+			UNLOCK();
+		} while (phase != 2 && usec_since(&start) < budget);
+
+		pthread_mutex_lock(&maint_mutex);
 	}
-	
-	//**If coalescing works &/or we freed pointer by request, return 0.**
+	pthread_mutex_unlock(&maint_mutex);
+	return NULL;
+}
+
+/*
+ * Function for tuning the background worker, may be called at any time
+ * Argument - period_ms: time between two rounds of upkeep
+ * Argument - budget_us: time the worker may spend per round
+ * Returns 0 on success and -1 on invalid arguments
+ */
+int Mem_Background_Config(int period_ms, int budget_us) {
+	if (period_ms <= 0 || budget_us <= 0)
+		return -1;
+	pthread_mutex_lock(&maint_mutex);
+	maint_period_ms = period_ms;
+	maint_budget_us = budget_us;
+	pthread_mutex_unlock(&maint_mutex);
 	return 0;
 }
 
+/*
+ * Function for stopping the background worker
+ * Waits for the current step to finish, the heap stays usable (and
+ * locked on every call) afterwards
+ * Returns 0 on success and -1 if no worker is running
+ */
+int Mem_Background_Stop() {
+	pthread_mutex_lock(&maint_mutex);
+	if (!maint_running) {
+		pthread_mutex_unlock(&maint_mutex);
+		return -1;
+	}
+	maint_running = 0;
+	pthread_cond_signal(&maint_cond);
+	pthread_mutex_unlock(&maint_mutex);
+	pthread_join(maint_thread, NULL);
+	return 0;
+}
 
 /*
  * Function used to initialize the memory allocator
  * Not intended to be called more than once by a program
  * Argument - sizeOfRegion: Specifies the size of the chunk which needs to be allocated
+ * Argument - flags: MEM_* options from mem.h, or 0
  * Returns 0 on success and -1 on failure 
+ * Nothing stays mapped after a failure, including a background worker
+ * that cannot be started, so the call can be retried
  */
-int Mem_Init(int sizeOfRegion) {                         
+int Mem_Init_Opts(int sizeOfRegion, int flags) {                         
     int pagesize;
     int padsize;
     int fd;
     int alloc_size;
+    int table_cap = 0;
+    int table_size = 0;
+    int bitmap_size = 0;
     void* space_ptr;
-    blk_hdr* end_mark;
+    void* table_ptr = NULL;
+    void* bitmap_ptr = NULL;
     static int allocated_once = 0;
   
     if (0 != allocated_once) {
@@ -256,6 +1062,7 @@ int Mem_Init(int sizeOfRegion) {
 
     // Get the pagesize
     pagesize = getpagesize();
+    page_size = pagesize;
 
     // Calculate padsize as the padding required to round up sizeOfRegion 
     // to a multiple of pagesize
@@ -270,41 +1077,118 @@ int Mem_Init(int sizeOfRegion) {
         fprintf(stderr, "Error:mem.c: Cannot open /dev/zero\n");
         return -1;
     }
+
+    // Side table: offsets and sizes, room for the most blocks that fit
+    if (flags & MEM_SIDE_TABLE) {
+        table_cap = alloc_size / 8;
+        table_size = 2 * table_cap * sizeof(int);
+        table_ptr = mmap(NULL, table_size, PROT_READ | PROT_WRITE, 
+                         MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == table_ptr) {
+            fprintf(stderr, "Error:mem.c: mmap cannot allocate side table\n");
+            close(fd);
+            return -1;
+        }
+    }
+
+    // Block-start bitmap: one bit per 8 byte granule
+    if (flags & MEM_HARDENED) {
+        bitmap_size = (alloc_size / 8 / 32 + 1) * sizeof(unsigned int);
+        bitmap_ptr = mmap(NULL, bitmap_size, PROT_READ | PROT_WRITE, 
+                          MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == bitmap_ptr) {
+            fprintf(stderr, "Error:mem.c: mmap cannot allocate bitmap\n");
+            if (table_ptr != NULL)
+                munmap(table_ptr, table_size);
+            close(fd);
+            return -1;
+        }
+    }
+
     space_ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, 
                     fd, 0);
+    close(fd);
     if (MAP_FAILED == space_ptr) {
         fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
+        if (table_ptr != NULL)
+            munmap(table_ptr, table_size);
+        if (bitmap_ptr != NULL)
+            munmap(bitmap_ptr, bitmap_size);
         allocated_once = 0;
         return -1;
     }
   
-    allocated_once = 1;
-
-    // for double word alignement and end mark
-    alloc_size -= 8;
-
-    // To begin with there is only one big free block
-    // initialize heap so that first block meets 
-    // double word alignement requirement
-    first_blk = (blk_hdr*) space_ptr + 1;
-    end_mark = (blk_hdr*)((void*)first_blk + alloc_size); //end_mark is the ptr to the end of free list/heap.
+    // To begin with there is only one big free block, its payload meets
+    // the double word alignment requirement and the end mark takes the
+    // last word of the region
+    if (core_attach(space_ptr, alloc_size, &first_blk, &end_mark) != 0) {
+        munmap(space_ptr, alloc_size);
+        if (table_ptr != NULL)
+            munmap(table_ptr, table_size);
+        if (bitmap_ptr != NULL)
+            munmap(bitmap_ptr, bitmap_size);
+        return -1;
+    }
   
-    // Setting up the header
-    first_blk->size_status = alloc_size;
-
-    // Marking the previous block as busy
-    first_blk->size_status += 2;
+    allocated_once = 1;
 
-    // Setting up the end mark and marking it as busy
-    end_mark->size_status = 1;
+    if (table_ptr != NULL) {
+        st_off = (int*)table_ptr;
+        st_size = st_off + table_cap;
+        st_count = 0;
+#if defined(__i386__) || defined(__x86_64__)
+        // MEM_ST_KERNEL=scalar|sse4.1|avx2 pins the search kernel so tests
+        // can cover each one, a kernel the cpu lacks falls back to scalar
+        const char *kernel = getenv("MEM_ST_KERNEL");
+        st_min = st_min_scalar;
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") &&
+            (kernel == NULL || strcmp(kernel, "avx2") == 0))
+            st_min = st_min_avx2;
+        else if (__builtin_cpu_supports("sse4.1") &&
+            (kernel == NULL || strcmp(kernel, "sse4.1") == 0))
+            st_min = st_min_sse41;
+#endif
+    }
+    bm = (unsigned int*)bitmap_ptr;
+    blk_changed(first_blk, end_mark);
 
-    // Setting up the footer
-    blk_hdr *footer = (blk_hdr*) ((char*)first_blk + alloc_size - 4);
-    footer->size_status = alloc_size;
+    if (flags & MEM_BACKGROUND) {
+        locking = 1;
+        maint_running = 1;
+        if (pthread_create(&maint_thread, NULL, maint_main, NULL) != 0) {
+            // Undo everything, the caller may try again
+            fprintf(stderr, "Error:mem.c: Cannot start background worker\n");
+            maint_running = 0;
+            locking = 0;
+            munmap(space_ptr, alloc_size);
+            if (table_ptr != NULL)
+                munmap(table_ptr, table_size);
+            if (bitmap_ptr != NULL)
+                munmap(bitmap_ptr, bitmap_size);
+            core_detach();
+            first_blk = NULL;
+            end_mark = NULL;
+            st_off = NULL;
+            st_size = NULL;
+            st_count = 0;
+            bm = NULL;
+            allocated_once = 0;
+            return -1;
+        }
+    }
   
     return 0;
 }
 
+/*
+ * Function used to initialize the memory allocator with default options
+ * Same as Mem_Init_Opts(sizeOfRegion, 0)
+ */
+int Mem_Init(int sizeOfRegion) {
+    return Mem_Init_Opts(sizeOfRegion, 0);
+}
+
 /* 
  * Function to be used for debugging 
  * Prints out a list of all the blocks along with the following information i
@@ -316,72 +1200,141 @@ int Mem_Init(int sizeOfRegion) {
  * t_End    : address of the last byte in the block 
  * t_Size   : size of the block (as stored in the block header) (including the header/footer)
  */ 
-void Mem_Dump() {                        
-    int counter;
-    char status[5];
-    char p_status[5];
-    char *t_begin = NULL;
-    char *t_end = NULL;
-    int t_size;
-
-    blk_hdr *current = first_blk;
-    counter = 1;
-
-    int busy_size = 0;
-    int free_size = 0;
-    int is_busy = -1;
-
-    fprintf(stdout, "************************************Block list***\
-                    ********************************\n");
-    fprintf(stdout, "No.\tStatus\tPrev\tt_Begin\t\tt_End\t\tt_Size\n");
-    fprintf(stdout, "-------------------------------------------------\
-                    --------------------------------\n");
-  
-    while (current->size_status != 1) {
-        t_begin = (char*)current;
-        t_size = current->size_status;
-    
-        if (t_size & 1) {
-            // LSB = 1 => busy block
-            strcpy(status, "Busy");
-            is_busy = 1;
-            t_size = t_size - 1;
-        } else {
-            strcpy(status, "Free");
-            is_busy = 0;
-        }
+void Mem_Dump() {
+    LOCK();
+    core_dump();
+    UNLOCK();
+}
+
+/*
+ * Function for starting an incremental walk over the block list
+ * Argument - w: cursor to initialize
+ */
+void Mem_Walk_Begin(mem_walk *w) {
+    LOCK();
+    w->offset = 0;
+    w->gen = heap_gen;
+    UNLOCK();
+}
 
-        if (t_size & 2) {
-            strcpy(p_status, "Busy");
-            t_size = t_size - 2;
-        } else {
-            strcpy(p_status, "Free");
+/*
+ * Puts the cursor back on a block start after the heap has changed
+ * Skips forward to the first block at or after the old offset. Only the
+ * side table and the bitmap can find it without walking the headers
+ * from first_blk.
+ */
+static blk_hdr* walk_resync(int offset) {
+    int end = (char*)end_mark - (char*)first_blk;
+    blk_hdr *blk;
+
+    if (offset >= end)
+        return end_mark;
+    if (st_off != NULL) { //Binary search in the side table.
+        int i = st_lower(offset);
+        return i < st_count ? (blk_hdr*)((char*)first_blk + st_off[i]) : end_mark;
+    }
+    if (bm != NULL) { //Next set bit in the block-start bitmap.
+        int i = offset / 8;
+        int last = end / 8;
+        while (i < last && !bm_test(i)) {
+            if (i % 32 == 0 && bm[i / 32] == 0)
+                i += 32;
+            else
+                i++;
         }
+        return i < last ? (blk_hdr*)((char*)first_blk + i * 8) : end_mark;
+    }
+    for (blk = first_blk; blk != end_mark; blk = blk_next(blk))
+        if ((char*)blk - (char*)first_blk >= offset)
+            break;
+    return blk;
+}
+
+static int walk_chunk(mem_walk *w, mem_blk_info *out, int max) {
+    blk_hdr *blk;
+    int n;
+
+    if (first_blk == NULL || w == NULL || out == NULL || max <= 0)
+        return -1;
+    if (w->gen == heap_gen)
+        blk = (blk_hdr*)((char*)first_blk + w->offset);
+    else
+        blk = walk_resync(w->offset);
 
-        if (is_busy) 
-            busy_size += t_size;
-        else 
-            free_size += t_size;
-
-        t_end = t_begin + t_size - 1;
-    
-        fprintf(stdout, "%d\t%s\t%s\t0x%08lx\t0x%08lx\t%d\n", counter, status, 
-        p_status, (unsigned long int)t_begin, (unsigned long int)t_end, t_size);
-    
-        current = (blk_hdr*)((char*)current + t_size);
-        counter = counter + 1;
+    for (n = 0; n < max && blk != end_mark; n++) {
+        out[n].offset = (char*)blk - (char*)first_blk;
+        out[n].size = blk_size(blk);
+        out[n].busy = blk->size_status & 1;
+        blk = blk_next(blk);
     }
+    w->offset = (char*)blk - (char*)first_blk;
+    w->gen = heap_gen;
+    return n;
+}
 
-    fprintf(stdout, "---------------------------------------------------\
-                    ------------------------------\n");
-    fprintf(stdout, "***************************************************\
-                    ******************************\n");
-    fprintf(stdout, "Total busy size = %d\n", busy_size);
-    fprintf(stdout, "Total free size = %d\n", free_size);
-    fprintf(stdout, "Total size = %d\n", busy_size + free_size);
-    fprintf(stdout, "***************************************************\
-                    ******************************\n");
-    fflush(stdout);
-
-    return;
+/*
+ * Function for visiting the block list a chunk at a time
+ * Arguments - w: cursor from Mem_Walk_Begin, out: room for max entries
+ * Returns the number of blocks stored in out, 0 once the walk is done,
+ * -1 on bad arguments
+ * The heap is locked for one call only. If it changed since the last
+ * call, the walk picks up at the first block at or after where it left
+ * off, so a block may be missed or merged but never reported twice.
+ * Finding that block is cheap with MEM_SIDE_TABLE or MEM_HARDENED,
+ * otherwise it takes a walk over the headers from the start of the heap.
+ */
+int Mem_Walk(mem_walk *w, mem_blk_info *out, int max) {
+    LOCK();
+    int rc = walk_chunk(w, out, max);
+    UNLOCK();
+    return rc;
+}
+
+/* Writes all of buf to fd, returns 0 on success and -1 on failure */
+static int write_all(int fd, const void *buf, int len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t done = write(fd, p, len);
+        if (done <= 0)
+            return -1;
+        p += done;
+        len -= done;
+    }
+    return 0;
+}
+
+/*
+ * Function for exporting the block list to a file descriptor
+ * Writes a mem_snap_hdr and one mem_snap_rec per block (see mem.h),
+ * built from Mem_Walk chunks so the heap is never locked for long
+ * Returns the number of blocks written, -1 on failure
+ */
+int Mem_Snapshot(int fd) {
+    mem_snap_hdr hdr;
+    mem_snap_rec rec[256];
+    mem_blk_info info[256];
+    mem_walk w;
+    int total = 0;
+    int n, i;
+
+    if (first_blk == NULL)
+        return -1;
+    hdr.magic = MEM_SNAP_MAGIC;
+    hdr.version = MEM_SNAP_VERSION;
+    hdr.heap_size = (char*)end_mark - (char*)first_blk;
+    hdr.reserved = 0;
+    if (write_all(fd, &hdr, sizeof(hdr)) != 0)
+        return -1;
+
+    Mem_Walk_Begin(&w);
+    while ((n = Mem_Walk(&w, info, 256)) > 0) {
+        for (i = 0; i < n; i++) {
+            rec[i].offset = info[i].offset;
+            rec[i].size_status = info[i].size | info[i].busy;
+        }
+        if (write_all(fd, rec, n * sizeof(mem_snap_rec)) != 0)
+            return -1;
+        total += n;
+    }
+    return n < 0 ? -1 : total;
 }
@@ -1,15 +1,111 @@
 #ifndef __mem_h__
 #define __mem_h__
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Options for Mem_Init_Opts */
+#define MEM_SIDE_TABLE  0x1   // keep block sizes in a side table for search
+#define MEM_BACKGROUND  0x2   // run compaction and trimming on a worker thread
+#define MEM_HARDENED    0x4   // reject pointers that are not block starts
+
+/* Lifetime classes for Mem_Alloc_Hint */
+#define MEM_LIFETIME_DEFAULT  0
+#define MEM_LIFETIME_SHORT    1
+#define MEM_LIFETIME_LONG     2
+
 int Mem_Init(int sizeOfRegion);
+int Mem_Init_Opts(int sizeOfRegion, int flags);
 void* Mem_Alloc(int size);
+void* Mem_Alloc_Hint(int size, int lifetime_class);
+int Mem_Alloc_Batch(int size, int n, void **out);
 int Mem_Free(void *ptr);
+int Mem_Free_Sized(void *ptr, int size);
+int Mem_Usable_Size(void *ptr);
+int Mem_Free_Batch(void **ptrs, int n);
 void Mem_Dump();
 
+/*
+ * Relocatable handles, at most MEM_MAX_HANDLES live at a time (per
+ * process); Mem_Handle_Alloc returns -1 while the table is full and freed
+ * handles are reused
+ */
+#define MEM_MAX_HANDLES 1024
+
+/*
+ * Handle blocks larger than MEM_COMPACT_MAX_MOVE bytes are never moved by
+ * Mem_Compact or the background worker, which bounds the copy done
+ * while the heap is locked
+ */
+#define MEM_COMPACT_MAX_MOVE (64 * 1024)
+
+int Mem_Handle_Alloc(int size);
+void* Mem_Handle_Lock(int h);
+int Mem_Handle_Unlock(int h);
+int Mem_Handle_Free(int h);
+int Mem_Compact(int budget_usec);
+
+int Mem_Background_Config(int period_ms, int budget_us);
+int Mem_Background_Stop();
+
+/* One block as seen by Mem_Walk, offset is relative to the first block */
+typedef struct mem_blk_info {
+    int offset;
+    int size;       // including header (and footer)
+    int busy;       // 1 = busy, 0 = free
+} mem_blk_info;
+
+/*
+ * Walk cursor, set up with Mem_Walk_Begin
+ * Each Mem_Walk call holds the heap lock for at most max blocks, as long
+ * as the heap has not changed since the previous call or one of
+ * MEM_SIDE_TABLE and MEM_HARDENED is on. Without them, a call after a
+ * change first walks the headers from the start of the heap to find its
+ * place again.
+ */
+typedef struct mem_walk {
+    int offset;     // next block to report
+    unsigned int gen;
+} mem_walk;
+
+void Mem_Walk_Begin(mem_walk *w);
+int Mem_Walk(mem_walk *w, mem_blk_info *out, int max);
+int Mem_Snapshot(int fd);
+
+/*
+ * Snapshot file layout (native byte order)
+ * One mem_snap_hdr followed by one mem_snap_rec per block, in address
+ * order, up to the end of the file
+ */
+#define MEM_SNAP_MAGIC    0x534d454d   // "MEMS"
+#define MEM_SNAP_VERSION  1
+
+typedef struct mem_snap_hdr {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int heap_size;   // bytes from the first block to the end mark
+    unsigned int reserved;
+} mem_snap_hdr;
+
+typedef struct mem_snap_rec {
+    unsigned int offset;
+    unsigned int size_status; // block size, LSB set if busy
+} mem_snap_rec;
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * The malloc stub keeps C test programs honest. It must not end up in
+ * libmem.so itself or in C++ clients, where it would interpose on the
+ * malloc behind operator new.
+ */
+#if !defined(__cplusplus) && !defined(MEM_NO_MALLOC_STUB)
 void* malloc(size_t size) {
     return NULL;
 }
+#endif
 
 #endif // __mem_h__
-
-
@@ -0,0 +1,62 @@
+/*
+ * The libmem instance of mem_core.hpp
+ *
+ * Exposes the block primitives of one heap with the mem.c policies to
+ * mem.c (see mem_core.h). Every change is reported back to mem.c, which
+ * keeps its side table, bitmap and pass cursors in step. Built without
+ * exceptions or RTTI, so libmem.so does not need libstdc++.
+ */
+#include <cstdint>
+
+#include "mem_core.h"
+#include "mem_core.hpp"
+
+struct c_observer {
+    static void changed(char* from, char* to) {
+        mem_blk_changed((blk_hdr*)from, (blk_hdr*)to);
+    }
+    static void dropped(char* blk) {
+        mem_blk_dropped((blk_hdr*)blk);
+    }
+};
+
+typedef mem::heap<uint32_t, 8, mem::best_fit, mem::immediate_coalesce,
+                  c_observer> c_heap;
+
+static c_heap heap;
+
+int core_attach(void *region, int size, blk_hdr **first, blk_hdr **end) {
+    if (heap.attach(region, size) != 0)
+        return -1;
+    *first = (blk_hdr*)heap.first();
+    *end = (blk_hdr*)heap.end();
+    return 0;
+}
+
+void core_detach(void) {
+    heap.detach();
+}
+
+int core_block_size(int size) {
+    return (int)c_heap::block_size(size);
+}
+
+blk_hdr* core_find(int size) {
+    return (blk_hdr*)heap.find(size);
+}
+
+void* core_carve(blk_hdr *blk, int size, int n) {
+    return heap.carve((char*)blk, size, n);
+}
+
+void* core_place_high(blk_hdr *blk, int size) {
+    return heap.place_high((char*)blk, size);
+}
+
+blk_hdr* core_free_span(blk_hdr *blk, blk_hdr *next) {
+    return (blk_hdr*)heap.free_span((char*)blk, (char*)next);
+}
+
+void core_dump(void) {
+    heap.dump();
+}
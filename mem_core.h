@@ -0,0 +1,57 @@
+#ifndef __mem_core_h__
+#define __mem_core_h__
+
+/*
+ * Block primitives of libmem, used by mem.c
+ *
+ * mem_core.cpp builds them from mem::heap (mem_core.hpp) with the libmem
+ * policies: 4 byte headers, 8 byte alignment, best fit and immediate
+ * coalescing. Sizes are block sizes (see core_block_size), blocks are
+ * passed by header. None of this is exported from libmem.so.
+ */
+
+struct blk_hdr;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#pragma GCC visibility push(hidden)
+
+/* Lays out the region as one free block, sets *first and *end (the end mark) */
+int core_attach(void *region, int size, struct blk_hdr **first,
+                struct blk_hdr **end);
+void core_detach(void);
+
+/* Block size for a request of size payload bytes, size > 0 */
+int core_block_size(int size);
+
+/* Best fit free block of at least size bytes, NULL if none fits */
+struct blk_hdr* core_find(int size);
+
+/* Marks n blocks of size bytes at the low end of blk busy, returns the first payload */
+void* core_carve(struct blk_hdr *blk, int size, int n);
+
+/* Marks the high size bytes of blk busy, returns the payload */
+void* core_place_high(struct blk_hdr *blk, int size);
+
+/* Frees the busy blocks in [blk, next) and coalesces, returns the free block */
+struct blk_hdr* core_free_span(struct blk_hdr *blk, struct blk_hdr *next);
+
+void core_dump(void);
+
+/*
+ * Defined in mem.c, called by the primitives above
+ * mem_blk_changed: the headers of the blocks in [from, to) were rewritten
+ * mem_blk_dropped: the header at blk is being merged away
+ */
+void mem_blk_changed(struct blk_hdr *from, struct blk_hdr *to);
+void mem_blk_dropped(struct blk_hdr *blk);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __mem_core_h__
@@ -0,0 +1,383 @@
+#ifndef __mem_core_hpp__
+#define __mem_core_hpp__
+
+/*
+ * Policy-templated allocator core, libmem.so is built on it
+ *
+ * mem::heap<Word, Align, Placement, Coalesce, Observer>
+ *   Word      - type of the header/footer word (uint32_t in libmem)
+ *   Align     - payload alignment and block size granularity (8 in libmem)
+ *   Placement - mem::best_fit or mem::first_fit
+ *   Coalesce  - mem::immediate_coalesce or mem::no_coalesce
+ *   Observer  - told about every block the primitives rewrite
+ *               (mem::no_observer by default)
+ *
+ * Block layout is the one described in mem.c: a header word right in front
+ * of the payload, size in the upper bits, LSB = busy, SLB = previous busy,
+ * footer in the last word of free blocks. The two low bits of a footer
+ * belong to the user (mem.c keeps trimming state there): footers written
+ * for new free space have them clear, a free block that only shrinks keeps
+ * them. Without coalescing nobody reads footers, so they are not written
+ * and the minimum block shrinks to a single header.
+ *
+ * Every policy is resolved at compile time. mem_core.cpp instantiates the
+ * libmem policies and hands the primitives below (find, carve, place_high,
+ * free_span) to mem.c, which layers the extensions on top of them.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace mem {
+
+struct best_fit {
+    static constexpr bool take_first = false;
+};
+
+struct first_fit {
+    static constexpr bool take_first = true;
+};
+
+struct immediate_coalesce {
+    static constexpr bool merge = true;
+};
+
+struct no_coalesce {
+    static constexpr bool merge = false;
+};
+
+/*
+ * changed(from, to): the headers of the blocks in [from, to) were rewritten
+ * dropped(blk): the header at blk is being merged away
+ */
+struct no_observer {
+    static void changed(char*, char*) {}
+    static void dropped(char*) {}
+};
+
+template <typename Word, std::size_t Align, typename Placement,
+          typename Coalesce, typename Observer = no_observer>
+class heap {
+    static_assert((Align & (Align - 1)) == 0, "Align must be a power of 2");
+    static_assert(Align >= 4, "the two low bits of a size hold the flags");
+    static_assert(sizeof(Word) <= Align, "header must fit in front of payload");
+
+    static constexpr Word BUSY = 1;
+    static constexpr Word PREV_BUSY = 2;
+    static constexpr Word FLAGS = 3;
+
+    static constexpr std::size_t round_up(std::size_t n) {
+        return (n + Align - 1) & ~(Align - 1);
+    }
+
+    // A free block has to hold its header and, when coalescing, its footer
+    static constexpr std::size_t min_blk =
+        round_up((Coalesce::merge ? 2 : 1) * sizeof(Word));
+
+    // Largest block size a header can hold next to the flag bits
+    static constexpr std::size_t max_blk =
+        (std::size_t)std::numeric_limits<Word>::max() & ~(Align - 1);
+
+ public:
+    typedef Word word_type;
+    static constexpr std::size_t alignment = Align;
+
+    /*
+     * Block size for a request of size payload bytes: header added,
+     * rounded up to Align, at least one minimal block
+     * Returns 0 if the header word cannot hold it
+     */
+    static constexpr std::size_t block_size(std::size_t size) {
+        if (size > max_blk - sizeof(Word))
+            return 0;
+        std::size_t need = round_up(size + sizeof(Word));
+        return need < min_blk ? min_blk : need;
+    }
+
+    /*
+     * Same contract as Mem_Init: maps sizeOfRegion bytes (rounded up to
+     * the page size) once, returns 0 on success and -1 on failure
+     */
+    int init(int sizeOfRegion) {
+        if (first_) {
+            fprintf(stderr,
+            "Error:mem_core: init has allocated space during a previous call\n");
+            return -1;
+        }
+        if (sizeOfRegion <= 0) {
+            fprintf(stderr, "Error:mem_core: Requested block size is not positive\n");
+            return -1;
+        }
+
+        std::size_t pagesize = getpagesize();
+        std::size_t alloc_size = (sizeOfRegion + pagesize - 1) / pagesize * pagesize;
+
+        int fd = open("/dev/zero", O_RDWR);
+        if (-1 == fd) {
+            fprintf(stderr, "Error:mem_core: Cannot open /dev/zero\n");
+            return -1;
+        }
+        void* space_ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (MAP_FAILED == space_ptr) {
+            fprintf(stderr, "Error:mem_core: mmap cannot allocate space\n");
+            return -1;
+        }
+        if (attach(space_ptr, alloc_size) != 0) {
+            munmap(space_ptr, alloc_size);
+            return -1;
+        }
+        return 0;
+    }
+
+    /*
+     * Lays out one free block over the size bytes at region, which must
+     * be Align aligned, a multiple of Align long and stay mapped while the
+     * heap uses it. The observer is not told, the caller knows.
+     * Returns 0 on success, -1 if size does not suit the header word
+     */
+    int attach(void* region, std::size_t size) {
+        if (size <= Align + min_blk) {
+            fprintf(stderr, "Error:mem_core: Region too small for one block\n");
+            return -1;
+        }
+        // Payloads start on an Align boundary, the header sits just before
+        // it and the end mark takes the last word of the region
+        std::size_t span = size - Align;
+        if (span > max_blk) {
+            fprintf(stderr, "Error:mem_core: Region too large for the header word\n");
+            return -1;
+        }
+
+        first_ = (char*)region + Align - sizeof(Word);
+        end_ = first_ + span;
+
+        hdr(first_) = (Word)span | PREV_BUSY;
+        hdr(end_) = BUSY;
+        if (Coalesce::merge)
+            ftr(first_) = (Word)span;
+        return 0;
+    }
+
+    /* Forgets the region, attach may be called again */
+    void detach() {
+        first_ = NULL;
+        end_ = NULL;
+    }
+
+    char* first() const { return first_; }
+    char* end() const { return end_; }
+
+    /*
+     * Same contract as Mem_Alloc: NULL on failure, otherwise an Align
+     * aligned payload of at least size bytes
+     */
+    void* alloc(int size) {
+        if (size <= 0 || !first_)
+            return NULL;
+        std::size_t need = block_size(size);
+        char* b = need ? find(need) : NULL;
+        if (!b)
+            return NULL;
+        return carve(b, need, 1);
+    }
+
+    /*
+     * Same contract as Mem_Free: -1 for NULL, misaligned, out of range or
+     * already free pointers, 0 otherwise
+     */
+    int free(void* ptr) {
+        if (!ptr || (std::uintptr_t)ptr % Align != 0)
+            return -1;
+        char* b = (char*)ptr - sizeof(Word);
+        if (b < first_) {
+            printf("Out of bounds leftwise in memfree\n");
+            return -1;
+        }
+        if (b >= end_)
+            return -1;
+        if (!(hdr(b) & BUSY))
+            return -1;
+        free_span(b, b + blk_size(b));
+        return 0;
+    }
+
+    /*
+     * Free block of at least need bytes picked by the placement policy,
+     * NULL if none fits. Best fit takes the first exact fit, otherwise
+     * the last of the smallest blocks that are large enough.
+     */
+    char* find(std::size_t need) const {
+        char* best = NULL;
+        std::size_t bestsize = 0;
+        for (char* b = first_; b != end_; b += blk_size(b)) {
+            Word cur = hdr(b);
+            std::size_t cursize = cur & ~FLAGS;
+            if ((cur & BUSY) || cursize < need)
+                continue;
+            if (Placement::take_first || cursize == need)
+                return b;
+            if (!best || cursize <= bestsize) {
+                best = b;
+                bestsize = cursize;
+            }
+        }
+        return best;
+    }
+
+    /*
+     * Marks n adjacent blocks of need bytes busy at the low end of the
+     * free block b, which must hold all of them. The rest stays free as
+     * a block after them, unless it is too small for one and goes to the
+     * last busy block. Returns the payload of the first block.
+     */
+    void* carve(char* b, std::size_t need, int n) {
+        std::size_t bsize = blk_size(b);
+        std::size_t rest = bsize - need * n;
+        char* next = b + bsize;
+        Word prev = hdr(b) & PREV_BUSY;
+        char* c = b;
+
+        for (int i = 0; i < n; i++) {
+            std::size_t csize = need;
+            if (i == n - 1 && rest < min_blk)
+                csize += rest;
+            hdr(c) = (Word)csize | prev | BUSY;
+            prev = PREV_BUSY;
+            c += csize;
+        }
+        if (c != next) {
+            hdr(c) = (Word)rest | PREV_BUSY;
+            if (Coalesce::merge)
+                last_word(next) = (Word)rest | (last_word(next) & FLAGS);
+        } else {
+            hdr(next) |= PREV_BUSY;
+        }
+        Observer::changed(b, next);
+        return b + sizeof(Word);
+    }
+
+    /*
+     * Marks the high need bytes of the free block b busy, the low part
+     * stays free in place (or goes with them if too small for a block)
+     * Returns the payload address
+     */
+    void* place_high(char* b, std::size_t need) {
+        std::size_t bsize = blk_size(b);
+        std::size_t rest = bsize - need;
+        if (rest < min_blk)
+            return carve(b, need, 1);
+
+        char* next = b + bsize;
+        Word bits = Coalesce::merge ? last_word(next) & FLAGS : 0;
+        hdr(b) = (Word)rest | (hdr(b) & PREV_BUSY);
+        if (Coalesce::merge)
+            ftr(b) = (Word)rest | bits;
+        char* busy = b + rest;
+        hdr(busy) = (Word)need | BUSY;
+        hdr(next) |= PREV_BUSY;
+        Observer::changed(b, next);
+        return busy + sizeof(Word);
+    }
+
+    /*
+     * Marks the consecutive busy blocks in [b, next) free; with
+     * coalescing they become one block together with their free
+     * neighbours. Returns the header of the block the span now starts in.
+     */
+    char* free_span(char* b, char* next) {
+        if (!Coalesce::merge) {
+            for (char* s = b; s != next; s += blk_size(s)) {
+                hdr(s) &= ~BUSY;
+                if (s != b)
+                    hdr(s) &= ~PREV_BUSY;
+            }
+            hdr(next) &= ~PREV_BUSY;
+            Observer::changed(b, next);
+            return b;
+        }
+
+        // Headers swallowed below stay behind as stale words, marked free
+        // so a second free of their payload is still rejected
+        for (char* s = b; s != next; s += blk_size(s)) {
+            Observer::dropped(s);
+            hdr(s) &= ~BUSY;
+        }
+        std::size_t size = next - b;
+        if (!(hdr(b) & PREV_BUSY)) {
+            std::size_t prevsize = last_word(b) & ~FLAGS;
+            b -= prevsize;
+            size += prevsize;
+        }
+        if (!(hdr(next) & BUSY)) {
+            Observer::dropped(next);
+            size += blk_size(next);
+            next += blk_size(next);
+        }
+        hdr(b) = (Word)size | (hdr(b) & PREV_BUSY);
+        ftr(b) = (Word)size;
+        hdr(next) &= ~PREV_BUSY;
+        Observer::changed(b, next);
+        return b;
+    }
+
+    /* Prints the block list in the Mem_Dump format */
+    void dump() const {
+        std::size_t busy_size = 0;
+        std::size_t free_size = 0;
+        int counter = 1;
+
+        fprintf(stdout, "************************************Block list***\
+                    ********************************\n");
+        fprintf(stdout, "No.\tStatus\tPrev\tt_Begin\t\tt_End\t\tt_Size\n");
+        fprintf(stdout, "-------------------------------------------------\
+                    --------------------------------\n");
+        for (char* b = first_; b && b != end_; b += blk_size(b)) {
+            std::size_t t_size = blk_size(b);
+            bool is_busy = hdr(b) & BUSY;
+            if (is_busy)
+                busy_size += t_size;
+            else
+                free_size += t_size;
+            fprintf(stdout, "%d\t%s\t%s\t0x%08lx\t0x%08lx\t%lu\n", counter,
+                    is_busy ? "Busy" : "Free",
+                    (hdr(b) & PREV_BUSY) ? "Busy" : "Free",
+                    (unsigned long)b, (unsigned long)(b + t_size - 1),
+                    (unsigned long)t_size);
+            counter++;
+        }
+        fprintf(stdout, "---------------------------------------------------\
+                    ------------------------------\n");
+        fprintf(stdout, "***************************************************\
+                    ******************************\n");
+        fprintf(stdout, "Total busy size = %lu\n", (unsigned long)busy_size);
+        fprintf(stdout, "Total free size = %lu\n", (unsigned long)free_size);
+        fprintf(stdout, "Total size = %lu\n",
+                (unsigned long)(busy_size + free_size));
+        fprintf(stdout, "***************************************************\
+                    ******************************\n");
+        fflush(stdout);
+    }
+
+ private:
+    static Word& hdr(char* b) { return *(Word*)b; }
+    static std::size_t blk_size(char* b) { return hdr(b) & ~FLAGS; }
+    static Word& ftr(char* b) {
+        return *(Word*)(b + blk_size(b) - sizeof(Word));
+    }
+    // Word right before p, the footer of a free block ending there
+    static Word& last_word(char* p) { return *(Word*)(p - sizeof(Word)); }
+
+    char* first_ = NULL;
+    char* end_ = NULL;
+};
+
+}  // namespace mem
+
+#endif // __mem_core_hpp__
@@ -0,0 +1,118 @@
+#ifndef __mem_resource_hpp__
+#define __mem_resource_hpp__
+
+/*
+ * C++ adapters over Mem_Alloc/Mem_Free
+ *
+ * mem::resource   - a std::pmr::memory_resource backed by the libmem heap
+ * mem::allocator  - a stateless allocator for the std:: containers
+ *
+ * Mem_Init must have been called before either one hands out memory.
+ * Sizes are passed through both ways: to Mem_Alloc on allocation and to
+ * Mem_Free_Sized on deallocation.
+ * Mem_Alloc returns 8 byte aligned payloads. Stricter alignments are
+ * served by over-allocating and stashing the raw pointer just below the
+ * aligned address.
+ */
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+
+#include "mem.h"
+
+namespace mem {
+
+constexpr std::size_t heap_align = 8;
+
+inline void* allocate_bytes(std::size_t bytes, std::size_t alignment) {
+    if (alignment <= heap_align) {
+        if (bytes > INT_MAX)
+            throw std::bad_alloc();
+        // Mem_Alloc rejects 0, containers may legally ask for it
+        void* p = Mem_Alloc(bytes ? (int)bytes : 1);
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    // Over-allocate by alignment: the aligned payload always lands at
+    // least one pointer past the raw block, which is where we keep it
+    if (bytes > INT_MAX - alignment)
+        throw std::bad_alloc();
+    void* raw = Mem_Alloc((int)(bytes + alignment));
+    if (!raw)
+        throw std::bad_alloc();
+    std::uintptr_t addr = (std::uintptr_t)raw + sizeof(void*);
+    addr = (addr + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+    ((void**)addr)[-1] = raw;
+    return (void*)addr;
+}
+
+// The size the container hands back goes to Mem_Free_Sized, which checks
+// it against the block
+inline void deallocate_bytes(void* p, std::size_t bytes, std::size_t alignment) {
+    if (alignment > heap_align)
+        Mem_Free_Sized(((void**)p)[-1], (int)(bytes + alignment));
+    else
+        Mem_Free_Sized(p, bytes ? (int)bytes : 1);
+}
+
+class resource : public std::pmr::memory_resource {
+ protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        return allocate_bytes(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes,
+                       std::size_t alignment) override {
+        deallocate_bytes(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other)
+        const noexcept override {
+        // There is only one libmem heap per process
+        return dynamic_cast<const resource*>(&other) != nullptr;
+    }
+};
+
+inline resource* heap_resource() {
+    static resource r;
+    return &r;
+}
+
+template <typename T>
+class allocator {
+ public:
+    typedef T value_type;
+
+    allocator() noexcept {}
+    template <typename U>
+    allocator(const allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n > SIZE_MAX / sizeof(T))
+            throw std::bad_alloc();
+        return (T*)allocate_bytes(n * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        deallocate_bytes(p, n * sizeof(T), alignof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const allocator<T>&, const allocator<U>&) noexcept {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const allocator<T>&, const allocator<U>&) noexcept {
+    return false;
+}
+
+}  // namespace mem
+
+#endif // __mem_resource_hpp__
@@ -0,0 +1,68 @@
+/* background worker compacts handles and trims free pages */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define NH 100
+
+int main() {
+   assert(Mem_Init_Opts(65536, MEM_BACKGROUND) == 0);
+   assert(Mem_Background_Config(0, 100) == -1);
+   assert(Mem_Background_Config(1, 2000) == 0);
+   int h[NH];
+   int i, tries;
+
+   for (i = 0; i < NH; i++) {
+      h[i] = Mem_Handle_Alloc(500);
+      assert(h[i] >= 0);
+      char *p = Mem_Handle_Lock(h[i]);
+      memset(p, i, 500);
+      assert(Mem_Handle_Unlock(h[i]) == 0);
+   }
+   //Every other handle goes, leaving holes of 512 bytes
+   for (i = 0; i < NH; i += 2)
+      assert(Mem_Handle_Free(h[i]) == 0);
+
+   //The worker slides the survivors down until one large hole is left
+   void *big = NULL;
+   for (tries = 0; tries < 3000 && big == NULL; tries++) {
+      big = Mem_Alloc(20000);
+      if (big == NULL)
+         usleep(1000);
+   }
+   assert(big != NULL);
+   for (i = 1; i < NH; i += 2) {
+      char *p = Mem_Handle_Lock(h[i]);
+      assert(p[0] == i && p[499] == i);
+      assert(Mem_Handle_Unlock(h[i]) == 0);
+   }
+
+   //A block reused before a second round keeps its pages
+   assert(Mem_Background_Config(1000, 2000) == 0);
+   usleep(5000);
+   memset(big, 0xff, 20000);
+   assert(Mem_Free(big) == 0);
+   char *again = Mem_Alloc(20000);
+   assert(again == big && again[8192] == (char)0xff);
+
+   //Pages of a block that stays free are given back and read as zeros
+   assert(Mem_Background_Config(1, 2000) == 0);
+   assert(Mem_Free(again) == 0);
+   for (tries = 0; tries < 100; tries++) {
+      usleep(20000);
+      again = Mem_Alloc(20000);
+      assert(again != NULL);
+      if (again[8192] == 0)
+         break;
+      assert(Mem_Free(again) == 0);
+   }
+   assert(again[8192] == 0);
+
+   assert(Mem_Background_Stop() == 0);
+   assert(Mem_Background_Stop() == -1);
+   assert(Mem_Free(again) == 0);
+   assert(Mem_Alloc(100) != NULL);
+   exit(0);
+}
@@ -0,0 +1,42 @@
+/* batch allocation from one block and batch free with coalescing */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   void *out[10];
+   static void *more[1000];
+   int i;
+
+   //20 bytes + 4 byte header pads to 24, all ten carved back to back
+   assert(Mem_Alloc_Batch(20, 10, out) == 0);
+   for (i = 0; i < 10; i++) {
+      assert(out[i] != NULL);
+      assert(((unsigned long)out[i]) % 8 == 0);
+      if (i > 0)
+         assert((char*)out[i] - (char*)out[i - 1] == 24);
+      memset(out[i], i, 20);
+   }
+   for (i = 0; i < 10; i++)
+      assert(((char*)out[i])[19] == i);
+
+   assert(Mem_Alloc_Batch(20, 1000, more) == -1);
+   assert(Mem_Alloc_Batch(0, 3, more) == -1);
+
+   //Out of order, with a duplicate and a bad pointer
+   void *ptrs[12];
+   for (i = 0; i < 10; i++)
+      ptrs[i] = out[(i * 7) % 10];
+   ptrs[10] = out[3];
+   ptrs[11] = (char*)out[4] + 4;
+   assert(Mem_Free_Batch(ptrs, 12) == -1);
+   assert(Mem_Free(out[0]) == -1);
+
+   //Everything is free and coalesced again
+   void *all = Mem_Alloc(4084);
+   assert(all != NULL);
+   assert(Mem_Free_Batch(&all, 1) == 0);
+   exit(0);
+}
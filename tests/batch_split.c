@@ -0,0 +1,29 @@
+/* batch allocation falls back to single blocks when no hole fits all */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   void *ptr[8];
+   void *out[4];
+   int i;
+   for (i = 0; i < 8; i++) {
+      ptr[i] = Mem_Alloc(500);
+      assert(ptr[i] != NULL);
+   }
+   //Holes of 504 bytes, none can take four 200 byte blocks
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_Free(ptr[3]) == 0);
+   assert(Mem_Free(ptr[5]) == 0);
+
+   assert(Mem_Alloc_Batch(200, 4, out) == 0);
+   for (i = 0; i < 4; i++)
+      assert(out[i] != NULL);
+
+   //Not enough room even one by one, nothing may stay allocated
+   void *big[8];
+   assert(Mem_Alloc_Batch(400, 8, big) == -1);
+   assert(Mem_Alloc(200) != NULL);
+   exit(0);
+}
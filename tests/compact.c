@@ -0,0 +1,49 @@
+/* relocatable handles: compaction merges the holes between them */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   int h[7];
+   int i;
+   //7 blocks of 512 (500 + 8 handle overhead + header, padded)
+   for (i = 0; i < 7; i++) {
+      h[i] = Mem_Handle_Alloc(500);
+      assert(h[i] >= 0);
+      char *p = Mem_Handle_Lock(h[i]);
+      assert(p != NULL);
+      assert(((unsigned long)p) % 8 == 0);
+      memset(p, 'a' + i, 500);
+      assert(Mem_Handle_Unlock(h[i]) == 0);
+   }
+   assert(Mem_Handle_Unlock(h[0]) == -1);
+
+   assert(Mem_Handle_Free(h[1]) == 0);
+   assert(Mem_Handle_Free(h[3]) == 0);
+   assert(Mem_Handle_Free(h[5]) == 0);
+   assert(Mem_Handle_Free(h[5]) == -1);
+
+   //2040 bytes free in total, but no hole is larger than 512
+   assert(Mem_Alloc(1500) == NULL);
+
+   //Run the pass in tiny slices
+   int rc;
+   while ((rc = Mem_Compact(1)) == 1)
+      ;
+   assert(rc == 0);
+
+   void *big = Mem_Alloc(1500);
+   assert(big != NULL);
+   assert(Mem_Free(big) == 0);
+
+   for (i = 0; i < 7; i += 2) {
+      char *p = Mem_Handle_Lock(h[i]);
+      int j;
+      for (j = 0; j < 500; j++)
+         assert(p[j] == 'a' + i);
+      assert(Mem_Handle_Unlock(h[i]) == 0);
+   }
+   exit(0);
+}
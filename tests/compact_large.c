@@ -0,0 +1,36 @@
+/* compaction leaves handle blocks above MEM_COMPACT_MAX_MOVE in place */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4 * MEM_COMPACT_MAX_MOVE) == 0);
+   int h0 = Mem_Handle_Alloc(500);
+   int big = Mem_Handle_Alloc(2 * MEM_COMPACT_MAX_MOVE);
+   int h1 = Mem_Handle_Alloc(500);
+   int h2 = Mem_Handle_Alloc(500);
+   assert(h0 >= 0 && big >= 0 && h1 >= 0 && h2 >= 0);
+
+   char *bigp = Mem_Handle_Lock(big);
+   memset(bigp, 'b', 2 * MEM_COMPACT_MAX_MOVE);
+   assert(Mem_Handle_Unlock(big) == 0);
+   char *p1 = Mem_Handle_Lock(h1);
+   assert(Mem_Handle_Unlock(h1) == 0);
+   char *p2 = Mem_Handle_Lock(h2);
+   memset(p2, 'c', 500);
+   assert(Mem_Handle_Unlock(h2) == 0);
+
+   //Holes in front of the big block and in front of h2
+   assert(Mem_Handle_Free(h0) == 0);
+   assert(Mem_Handle_Free(h1) == 0);
+   assert(Mem_Compact(0) == 0);
+
+   //The big block stays, the small one behind it still slides down
+   assert(Mem_Handle_Lock(big) == bigp);
+   assert(bigp[0] == 'b' && bigp[2 * MEM_COMPACT_MAX_MOVE - 1] == 'b');
+   p2 = Mem_Handle_Lock(h2);
+   assert(p2 == p1);
+   assert(p2[0] == 'c' && p2[499] == 'c');
+   exit(0);
+}
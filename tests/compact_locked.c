@@ -0,0 +1,42 @@
+/* locked handles and plain blocks stay put during compaction */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   int h[4];
+   int i;
+   for (i = 0; i < 4; i++) {
+      h[i] = Mem_Handle_Alloc(100);
+      assert(h[i] >= 0);
+   }
+   void *plain = Mem_Alloc(100);
+   assert(plain != NULL);
+   int h4 = Mem_Handle_Alloc(100);
+   assert(h4 >= 0);
+
+   char *pinned = Mem_Handle_Lock(h[2]);
+   assert(pinned != NULL);
+   *pinned = 'x';
+   assert(Mem_Handle_Free(h[2]) == -1); //Still locked.
+
+   assert(Mem_Handle_Free(h[0]) == 0);
+   assert(Mem_Handle_Free(h[1]) == 0);
+   assert(Mem_Handle_Free(h[3]) == 0);
+
+   assert(Mem_Compact(0) == 0);
+
+   //h[2] is locked and 'plain' has no handle, neither may move
+   assert(Mem_Handle_Lock(h[2]) == pinned);
+   assert(*pinned == 'x');
+   assert(Mem_Handle_Unlock(h[2]) == 0);
+   assert(Mem_Handle_Unlock(h[2]) == 0);
+   assert(Mem_Free(plain) == 0);
+   assert(Mem_Handle_Free(h[2]) == 0);
+   assert(Mem_Handle_Free(h4) == 0);
+
+   //Everything is free and coalesced again
+   assert(Mem_Alloc(4000) != NULL);
+   exit(0);
+}
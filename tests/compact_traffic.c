@@ -0,0 +1,28 @@
+/* a compaction pass keeps its place while other blocks come and go */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+#define NBLK 20000
+
+static void *blk[NBLK];
+
+int main() {
+   assert(Mem_Init(8 * NBLK + 4096) == 0);
+   void *front = Mem_Alloc(100);
+   assert(front != NULL);
+   assert(Mem_Alloc_Batch(1, NBLK, blk) == 0);
+
+   //One short step per call, with a free and an allocation in between
+   int calls, rc = 1;
+   for (calls = 0; calls < 10 * NBLK && rc == 1; calls++) {
+      rc = Mem_Compact(1);
+      assert(Mem_Free(front) == 0);
+      front = Mem_Alloc(100);
+      assert(front != NULL);
+   }
+   assert(rc == 0);
+   //Each call moved the pass forward
+   assert(calls > 1 && calls <= NBLK / 64 + 2);
+   exit(0);
+}
@@ -0,0 +1,71 @@
+/* mem_core.hpp with other policies: first fit, no coalescing, 16 and 64 bit words */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "mem_core.hpp"
+
+int main() {
+   //16 bit headers cannot describe a block of 128k
+   mem::heap<uint16_t, 8, mem::best_fit, mem::immediate_coalesce> narrow;
+   assert(narrow.init(128 * 1024) == -1);
+   assert(narrow.init(64 * 1024) == 0);
+   char *n1 = (char*)narrow.alloc(30000);
+   char *n2 = (char*)narrow.alloc(30000);
+   assert(n1 != NULL && n2 != NULL);
+   assert((uintptr_t)n1 % 8 == 0 && n2 == n1 + 30008);
+   assert(narrow.alloc(30000) == NULL);
+   assert(narrow.free(n1) == 0 && narrow.free(n2) == 0);
+   //Whole span again: 65528 bytes, 2 of them header
+   assert(narrow.alloc(65527) == NULL);
+   assert(narrow.alloc(65526) == n1);
+
+   //First fit takes the first hole, best fit the tightest one
+   mem::heap<uint32_t, 8, mem::first_fit, mem::immediate_coalesce> first;
+   mem::heap<uint32_t, 8, mem::best_fit, mem::immediate_coalesce> best;
+   assert(first.init(4096) == 0 && best.init(4096) == 0);
+   char *fa = (char*)first.alloc(200);
+   char *fb = (char*)first.alloc(10);
+   char *fc = (char*)first.alloc(100);
+   assert(first.alloc(10) != NULL);
+   char *ba = (char*)best.alloc(200);
+   char *bb = (char*)best.alloc(10);
+   char *bc = (char*)best.alloc(100);
+   assert(best.alloc(10) != NULL);
+   assert(fb != NULL && bb != NULL);
+   assert(first.free(fa) == 0 && first.free(fc) == 0);
+   assert(best.free(ba) == 0 && best.free(bc) == 0);
+   assert(first.alloc(100) == fa);
+   assert(best.alloc(100) == bc);
+
+   //Without coalescing two adjacent free blocks stay two blocks
+   mem::heap<uint32_t, 8, mem::best_fit, mem::no_coalesce> nomerge;
+   mem::heap<uint32_t, 8, mem::best_fit, mem::immediate_coalesce> merge;
+   assert(nomerge.init(4096) == 0 && merge.init(4096) == 0);
+   char *na = (char*)nomerge.alloc(1500);
+   char *nb = (char*)nomerge.alloc(1500);
+   char *ma = (char*)merge.alloc(1500);
+   char *mb = (char*)merge.alloc(1500);
+   assert(na != NULL && nb != NULL && ma != NULL && mb != NULL);
+   assert(nomerge.free(na) == 0 && nomerge.free(nb) == 0);
+   assert(merge.free(ma) == 0 && merge.free(mb) == 0);
+   assert(nomerge.alloc(2000) == NULL);
+   assert(nomerge.alloc(1500) == na);
+   assert(merge.alloc(2000) == ma);
+
+   //64 bit headers with 16 byte alignment
+   mem::heap<uint64_t, 16, mem::best_fit, mem::immediate_coalesce> wide;
+   assert(wide.init(4096) == 0);
+   char *w[8];
+   int i;
+   for (i = 0; i < 8; i++) {
+      w[i] = (char*)wide.alloc(1 + i * 40);
+      assert(w[i] != NULL && (uintptr_t)w[i] % 16 == 0);
+   }
+   for (i = 0; i < 8; i += 2)
+      assert(wide.free(w[i]) == 0);
+   for (i = 1; i < 8; i += 2)
+      assert(wide.free(w[i]) == 0);
+   assert(wide.free(w[1]) == -1);
+   assert(wide.alloc(4096 - 16 - 8) == w[0]);
+   exit(0);
+}
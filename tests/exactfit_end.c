@@ -0,0 +1,16 @@
+/* an exact fit of the last block must not hide the end mark */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   //4084 + 4 byte header is the whole 4088 byte heap
+   void *p = Mem_Alloc(4084);
+   assert(p != NULL);
+   assert(Mem_Alloc(8) == NULL);
+   Mem_Dump();
+   assert(Mem_Free(p) == 0);
+   assert(Mem_Alloc(8) != NULL);
+   exit(0);
+}
@@ -0,0 +1,33 @@
+/* handle table: -1 once MEM_MAX_HANDLES are live, freed handles are reused */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   //Each handle block is 16 bytes (1 + 8 handle overhead + header, padded)
+   assert(Mem_Init(16 * MEM_MAX_HANDLES + 4096) == 0);
+   int h[MEM_MAX_HANDLES];
+   int i;
+   for (i = 0; i < MEM_MAX_HANDLES; i++) {
+      h[i] = Mem_Handle_Alloc(1);
+      assert(h[i] >= 0);
+   }
+   assert(Mem_Handle_Alloc(1) == -1);
+   //The heap itself still has room
+   assert(Mem_Alloc(1000) != NULL);
+
+   //Released slots come back, last released first
+   assert(Mem_Handle_Free(h[10]) == 0);
+   assert(Mem_Handle_Free(h[500]) == 0);
+   assert(Mem_Handle_Alloc(1) == h[500]);
+   assert(Mem_Handle_Alloc(1) == h[10]);
+   assert(Mem_Handle_Alloc(1) == -1);
+
+   //A failed allocation does not use up a released slot
+   assert(Mem_Handle_Free(h[7]) == 0);
+   assert(Mem_Handle_Alloc(1 << 20) == -1);
+   assert(Mem_Handle_Alloc(1) == h[7]);
+   assert(Mem_Handle_Lock(h[7]) != NULL);
+   assert(Mem_Handle_Unlock(h[7]) == 0);
+   exit(0);
+}
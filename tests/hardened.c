@@ -0,0 +1,47 @@
+/* hardened mode rejects interior, stale and out of range pointers */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init_Opts(4096, MEM_HARDENED) == 0);
+   char *ptr[4];
+   int i;
+   for (i = 0; i < 4; i++) {
+      ptr[i] = Mem_Alloc(100);
+      assert(ptr[i] != NULL);
+   }
+
+   //Payload that looks like a busy header 4 bytes before ptr + 8
+   memset(ptr[0], 0xff, 100);
+   assert(Mem_Free(ptr[0] + 8) == -1);
+   assert(Mem_Free(ptr[0] + 96) == -1);
+
+   //Past the end of the heap
+   assert(Mem_Free(ptr[3] + 8192) == -1);
+
+   //ptr[1] is merged into ptr[0]'s free block, its old header is stale
+   assert(Mem_Free(ptr[0]) == 0);
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_Free(ptr[1]) == -1);
+   assert(Mem_Free(ptr[0]) == -1);
+
+   //Batch free goes through the same check
+   void *batch[3];
+   batch[0] = ptr[2];
+   batch[1] = ptr[2] + 16;
+   batch[2] = ptr[3];
+   assert(Mem_Free_Batch(batch, 3) == -1);
+
+   //A sized free with the wrong size is rejected
+   char *sized = Mem_Alloc(100);
+   assert(sized != NULL);
+   assert(Mem_Free_Sized(sized, 50) == -1);
+   assert(Mem_Free_Sized(sized, 204) == -1);
+   assert(Mem_Free_Sized(sized, 100) == 0);
+
+   //Still one consistent heap
+   assert(Mem_Alloc(4084) != NULL);
+   exit(0);
+}
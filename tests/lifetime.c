@@ -0,0 +1,31 @@
+/* lifetime hints keep short and long lived blocks at opposite ends */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   char *s0 = Mem_Alloc_Hint(100, MEM_LIFETIME_SHORT);
+   char *l0 = Mem_Alloc_Hint(100, MEM_LIFETIME_LONG);
+   char *s1 = Mem_Alloc_Hint(200, MEM_LIFETIME_SHORT);
+   char *l1 = Mem_Alloc_Hint(200, MEM_LIFETIME_LONG);
+   assert(s0 != NULL && l0 != NULL && s1 != NULL && l1 != NULL);
+   assert(((unsigned long)l0) % 8 == 0);
+   assert(((unsigned long)l1) % 8 == 0);
+   assert(s0 < s1 && s1 < l1 && l1 < l0);
+   //4088 byte heap, the first long block (104 bytes) ends at the end mark
+   assert(l0 - s0 == 4088 - 104);
+   assert(Mem_Alloc_Hint(8, 7) == NULL);
+
+   //Short blocks freed in the middle coalesce with the gap
+   assert(Mem_Free(s0) == 0);
+   assert(Mem_Free(s1) == 0);
+   char *big = Mem_Alloc(4088 - 104 - 208 - 4);
+   assert(big == s0);
+   assert(Mem_Free(big) == 0);
+
+   assert(Mem_Free(l1) == 0);
+   assert(Mem_Free(l0) == 0);
+   assert(Mem_Alloc(4084) != NULL);
+   exit(0);
+}
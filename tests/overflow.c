@@ -0,0 +1,29 @@
+/* requests near INT_MAX are rejected instead of wrapping to tiny blocks */
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   void *out[2];
+   int i;
+   for (i = 0; i <= 12; i++) {
+      assert(Mem_Alloc(INT_MAX - i) == NULL);
+      assert(Mem_Alloc_Hint(INT_MAX - i, MEM_LIFETIME_SHORT) == NULL);
+      assert(Mem_Alloc_Hint(INT_MAX - i, MEM_LIFETIME_LONG) == NULL);
+      assert(Mem_Alloc_Batch(INT_MAX - i, 1, out) == -1);
+   }
+   //Handle blocks add 8 bytes for the handle word on top
+   for (i = 0; i <= 20; i++)
+      assert(Mem_Handle_Alloc(INT_MAX - i) == -1);
+   //Padded size times n does not fit in an int either
+   assert(Mem_Alloc_Batch(INT_MAX / 2, 2, out) == -1);
+
+   //The heap is untouched: one block of 4088
+   void *p = Mem_Alloc(4084);
+   assert(p != NULL);
+   assert(Mem_Free_Sized(p, INT_MAX) == -1);
+   assert(Mem_Free_Sized(p, 4084) == 0);
+   exit(0);
+}
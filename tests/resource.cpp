@@ -0,0 +1,74 @@
+/* C++ adapters: over-aligned types, empty allocations and resource equality */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <climits>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <vector>
+#include "mem_resource.hpp"
+
+struct alignas(64) line {
+   char bytes[64];
+};
+
+int main() {
+   assert(Mem_Init(65536) == 0);
+   int i;
+   {
+      std::vector<line, mem::allocator<line> > v;
+      std::pmr::vector<line> pv(mem::heap_resource());
+      std::map<int, int, std::less<int>,
+               mem::allocator<std::pair<const int, int> > > m;
+      for (i = 0; i < 100; i++) {
+         line l;
+         l.bytes[0] = i;
+         l.bytes[63] = -i;
+         v.push_back(l);
+         pv.push_back(l);
+         m[i] = -i;
+         assert((uintptr_t)&v.back() % 64 == 0);
+         assert((uintptr_t)&pv.back() % 64 == 0);
+      }
+      for (i = 0; i < 100; i++) {
+         assert(v[i].bytes[0] == i && v[i].bytes[63] == (char)-i);
+         assert(pv[i].bytes[0] == i && pv[i].bytes[63] == (char)-i);
+         assert(m[i] == -i);
+      }
+   }
+
+   //Containers may ask for 0 bytes, at any alignment
+   std::pmr::memory_resource *r = mem::heap_resource();
+   void *p = r->allocate(0, 8);
+   void *q = r->allocate(0, 64);
+   assert(p != NULL && q != NULL && (uintptr_t)q % 64 == 0);
+   r->deallocate(q, 0, 64);
+   r->deallocate(p, 0, 8);
+
+   //Every mem::resource is the same heap, other resources are not
+   mem::resource other;
+   assert(r->is_equal(other));
+   assert(!r->is_equal(*std::pmr::new_delete_resource()));
+   assert(mem::allocator<int>() == mem::allocator<line>());
+
+   //Sizes the heap cannot describe throw instead of wrapping around
+   bool threw = false;
+   try {
+      (void)r->allocate(INT_MAX - 3, 8);
+   } catch (const std::bad_alloc&) {
+      threw = true;
+   }
+   assert(threw);
+   threw = false;
+   try {
+      mem::allocator<char>().allocate(INT_MAX);
+   } catch (const std::bad_alloc&) {
+      threw = true;
+   }
+   assert(threw);
+
+   //All of it came back: one free block of 65528 bytes
+   assert(Mem_Alloc(65524) != NULL);
+   exit(0);
+}
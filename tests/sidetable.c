@@ -0,0 +1,131 @@
+/* best fit through the side table, checked against random churn and
+ * against the plain walk with every search kernel */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "mem.h"
+
+#define N 64
+#define ROUNDS 20000
+
+//Churn in a fresh heap, writing the offset of every block handed out
+static void replay(int flags) {
+   char *ptr[N];
+   int off[ROUNDS];
+   int i, n = 0, round;
+   assert(Mem_Init_Opts(65536, flags) == 0);
+   char *base = Mem_Alloc(8);
+   assert(base != NULL);
+   memset(ptr, 0, sizeof(ptr));
+   srand(2);
+   for (round = 0; round < ROUNDS; round++) {
+      i = rand() % N;
+      if (ptr[i] != NULL) {
+         assert(Mem_Free(ptr[i]) == 0);
+         ptr[i] = NULL;
+      } else {
+         //Many equal sizes so ties between holes come up
+         int size = rand() % 4 ? 8 * (1 + rand() % 12) : 1 + rand() % 700;
+         ptr[i] = Mem_Alloc(size);
+         off[n++] = ptr[i] != NULL ? (int)(ptr[i] - base) : -1;
+      }
+   }
+   assert(write(1, off, n * sizeof(int)) == (ssize_t)(n * sizeof(int)));
+}
+
+//Runs this test as "<mode> <kernel>" and collects the offsets it writes
+static int run(char *mode, char *kernel, int *off) {
+   int fd[2];
+   int n = 0;
+   ssize_t got;
+   assert(pipe(fd) == 0);
+   pid_t pid = fork();
+   assert(pid >= 0);
+   if (pid == 0) {
+      char env[64] = "MEM_ST_KERNEL=";
+      char *argv[] = { "sidetable", mode, NULL };
+      char *envp[] = { env, NULL };
+      strcat(env, kernel);
+      dup2(fd[1], 1);
+      execve("/proc/self/exe", argv, envp);
+      _exit(127);
+   }
+   close(fd[1]);
+   while ((got = read(fd[0], (char*)off + n, ROUNDS * sizeof(int) - n)) > 0)
+      n += got;
+   close(fd[0]);
+   int status;
+   assert(waitpid(pid, &status, 0) == pid);
+   assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+   return n / sizeof(int);
+}
+
+int main(int argc, char *argv[]) {
+   if (argc > 1) {
+      replay(strcmp(argv[1], "table") == 0 ? MEM_SIDE_TABLE : 0);
+      exit(0);
+   }
+
+   //The side table must pick the block the walk picks, whatever the kernel
+   static int walk[ROUNDS], table[ROUNDS];
+   char *kernels[] = { "", "scalar", "sse4.1", "avx2" };
+   int k, nwalk = run("walk", "", walk);
+   assert(nwalk > ROUNDS / 4);
+   for (k = 0; k < 4; k++) {
+      assert(run("table", kernels[k], table) == nwalk);
+      assert(memcmp(walk, table, nwalk * sizeof(int)) == 0);
+   }
+
+   assert(Mem_Init_Opts(65536, MEM_SIDE_TABLE) == 0);
+   char *ptr[N];
+   int size[N];
+   int i, round;
+
+   //Same layout as bestfit: the 50 byte request must land in the 100 byte hole
+   void *p[5];
+   p[0] = Mem_Alloc(300);
+   p[1] = Mem_Alloc(100);
+   p[2] = Mem_Alloc(200);
+   p[3] = Mem_Alloc(800);
+   p[4] = Mem_Alloc(100);
+   for (i = 0; i < 5; i++)
+      assert(p[i] != NULL);
+   assert(Mem_Free(p[1]) == 0);
+   assert(Mem_Free(p[3]) == 0);
+   void *test = Mem_Alloc(50);
+   assert(test == p[1]);
+   assert(Mem_Free(test) == 0);
+   assert(Mem_Free(p[0]) == 0);
+   assert(Mem_Free(p[2]) == 0);
+   assert(Mem_Free(p[4]) == 0);
+
+   //Random churn, every block keeps a pattern that must survive
+   memset(ptr, 0, sizeof(ptr));
+   srand(1);
+   for (round = 0; round < ROUNDS; round++) {
+      i = rand() % N;
+      if (ptr[i] != NULL) {
+         int j;
+         for (j = 0; j < size[i]; j++)
+            assert(ptr[i][j] == (char)i);
+         assert(Mem_Free(ptr[i]) == 0);
+         ptr[i] = NULL;
+      } else {
+         size[i] = 1 + rand() % 700;
+         ptr[i] = Mem_Alloc(size[i]);
+         if (ptr[i] != NULL) {
+            assert(((unsigned long)ptr[i]) % 8 == 0);
+            memset(ptr[i], i, size[i]);
+         }
+      }
+   }
+   for (i = 0; i < N; i++)
+      if (ptr[i] != NULL)
+         assert(Mem_Free(ptr[i]) == 0);
+
+   //Everything coalesced back into one block
+   assert(Mem_Alloc(65000) != NULL);
+   exit(0);
+}
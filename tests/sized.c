@@ -0,0 +1,39 @@
+/* sized free and usable size query */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   char *a = Mem_Alloc(1);
+   char *b = Mem_Alloc(13);
+   char *c = Mem_Alloc(100);
+   assert(a != NULL && b != NULL && c != NULL);
+
+   //Payload rounded up: header + payload is a multiple of 8
+   assert(Mem_Usable_Size(a) == 4);
+   assert(Mem_Usable_Size(b) == 20);
+   assert(Mem_Usable_Size(c) == 100);
+   assert(Mem_Usable_Size(NULL) == -1);
+   assert(Mem_Usable_Size(b + 4) == -1);
+
+   //The whole usable size can be written without touching neighbours
+   memset(a, 'a', Mem_Usable_Size(a));
+   memset(c, 'c', Mem_Usable_Size(c));
+   memset(b, 'b', Mem_Usable_Size(b));
+   assert(a[3] == 'a' && c[0] == 'c');
+
+   //A size that pads to a different block is rejected
+   assert(Mem_Free_Sized(b, 40) == -1);
+   assert(Mem_Free_Sized(b, 0) == -1);
+   //Any size up to the usable size names the same block
+   assert(Mem_Free_Sized(b, 18) == 0);
+   assert(Mem_Free_Sized(b, 13) == -1);
+   assert(Mem_Usable_Size(b) == -1);
+
+   assert(Mem_Free_Sized(a, 1) == 0);
+   assert(Mem_Free_Sized(c, 100) == 0);
+   assert(Mem_Alloc(4084) != NULL);
+   exit(0);
+}
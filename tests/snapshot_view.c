@@ -0,0 +1,85 @@
+/* memsnap reads back a Mem_Snapshot file, walks resync through the side table */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+
+static char out[8192];
+
+/* Runs ../tools/memsnap with args, returns its exit status, output in out */
+static int memsnap(char *file, char *cols, char *rows) {
+   int fds[2];
+   int status;
+   int len = 0;
+   ssize_t n;
+   assert(pipe(fds) == 0);
+   pid_t pid = fork();
+   assert(pid >= 0);
+   if (pid == 0) {
+      dup2(fds[1], 1);
+      close(fds[0]);
+      execl("../tools/memsnap", "memsnap", file, cols, rows, (char*)NULL);
+      _exit(127);
+   }
+   close(fds[1]);
+   while ((n = read(fds[0], out + len, sizeof(out) - 1 - len)) > 0)
+      len += n;
+   out[len] = '\0';
+   close(fds[0]);
+   assert(waitpid(pid, &status, 0) == pid);
+   return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main() {
+   assert(Mem_Init_Opts(4096, MEM_SIDE_TABLE) == 0);
+   void *ptr[6];
+   int i;
+   for (i = 0; i < 6; i++) {
+      ptr[i] = Mem_Alloc(100);
+      assert(ptr[i] != NULL);
+   }
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_Free(ptr[3]) == 0);
+
+   //busy free busy free busy busy + the free rest of 3464
+   char file[] = "/tmp/memsnapXXXXXX";
+   int fd = mkstemp(file);
+   assert(fd >= 0);
+   assert(Mem_Snapshot(fd) == 7);
+   close(fd);
+
+   assert(memsnap(file, "8", "1") == 0);
+   assert(strstr(out, "heap size      4088 bytes\n") != NULL);
+   assert(strstr(out, "blocks         7 (4 busy, 3 free)\n") != NULL);
+   assert(strstr(out, "busy bytes     416\n") != NULL);
+   assert(strstr(out, "free bytes     3672\n") != NULL);
+   assert(strstr(out, "largest free   3464\n") != NULL);
+   assert(strstr(out, "fragmentation  0.057") != NULL);
+   //511 bytes per cell, busy blocks end at 624
+   assert(strstr(out, "\n++......\n") != NULL);
+   assert(strstr(out, "64 - 127             2 blocks        208 bytes") != NULL);
+   assert(strstr(out, "2048 - 4095            1 blocks       3464 bytes") != NULL);
+
+   //Bad map size, then something that is not a snapshot
+   assert(memsnap(file, "0", "1") == 2);
+   fd = open(file, O_WRONLY | O_TRUNC);
+   assert(fd >= 0);
+   assert(write(fd, "not a heap snapshot", 19) == 19);
+   close(fd);
+   assert(memsnap(file, "8", "1") == 1);
+   unlink(file);
+
+   //The side table puts a walk back on the next block after a change
+   mem_walk w;
+   mem_blk_info info[2];
+   Mem_Walk_Begin(&w);
+   assert(Mem_Walk(&w, info, 2) == 2);
+   assert(Mem_Free(ptr[2]) == 0);   //Merges blocks 1-3, the walk was at 2
+   assert(Mem_Walk(&w, info, 2) == 2);
+   assert(info[0].offset == 416 && info[0].busy == 1);
+   assert(info[1].offset == 520 && info[1].busy == 1);
+   exit(0);
+}
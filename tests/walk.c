@@ -0,0 +1,61 @@
+/* incremental walk in small chunks and binary snapshot export */
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "mem.h"
+
+int main() {
+   assert(Mem_Init(4096) == 0);
+   void *ptr[6];
+   mem_walk w;
+   mem_blk_info info[2];
+   int i, n;
+
+   for (i = 0; i < 6; i++) {
+      ptr[i] = Mem_Alloc(100);
+      assert(ptr[i] != NULL);
+   }
+   assert(Mem_Free(ptr[1]) == 0);
+   assert(Mem_Free(ptr[3]) == 0);
+
+   //7 blocks: busy free busy free busy busy + the free rest
+   int blocks = 0, offset = 0, busy = 0;
+   Mem_Walk_Begin(&w);
+   while ((n = Mem_Walk(&w, info, 2)) > 0) {
+      assert(n <= 2);
+      for (i = 0; i < n; i++) {
+         assert(info[i].offset == offset);
+         offset += info[i].size;
+         busy += info[i].busy;
+         blocks++;
+      }
+   }
+   assert(n == 0);
+   assert(blocks == 7 && busy == 4 && offset == 4088);
+
+   //Heap changes between chunks: the walk resumes and stays ordered
+   Mem_Walk_Begin(&w);
+   assert(Mem_Walk(&w, info, 2) == 2);
+   assert(Mem_Free(ptr[2]) == 0);   //Merges blocks 2-4 into block 1
+   offset = info[1].offset;
+   while ((n = Mem_Walk(&w, info, 2)) > 0)
+      for (i = 0; i < n; i++) {
+         assert(info[i].offset > offset);
+         offset = info[i].offset;
+      }
+   assert(Mem_Walk(&w, NULL, 2) == -1);
+
+   //Snapshot: header plus one 8 byte record per block
+   int fds[2];
+   assert(pipe(fds) == 0);
+   assert(Mem_Snapshot(fds[1]) == 5);
+   close(fds[1]);
+   mem_snap_hdr hdr;
+   mem_snap_rec rec[8];
+   assert(read(fds[0], &hdr, sizeof(hdr)) == sizeof(hdr));
+   assert(hdr.magic == MEM_SNAP_MAGIC && hdr.heap_size == 4088);
+   assert(read(fds[0], rec, sizeof(rec)) == 5 * sizeof(mem_snap_rec));
+   assert(rec[0].offset == 0 && rec[0].size_status == (104 | 1));
+   assert(rec[1].offset == 104 && rec[1].size_status == 3 * 104);
+   exit(0);
+}
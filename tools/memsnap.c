@@ -0,0 +1,146 @@
+/*
+ * Offline viewer for Mem_Snapshot files
+ *
+ * Usage: memsnap <snapshot> [columns [rows]]
+ *
+ * Prints a summary, a fragmentation map of the heap (each cell covers an
+ * equal slice of it: '#' all busy, '.' all free, '+' mixed) and a
+ * histogram of free block sizes in power of two buckets.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define MAX_COLS 200
+#define MAX_ROWS 100
+#define BUCKETS  32
+
+static long busy_in_cell[MAX_COLS * MAX_ROWS];
+
+/* Counts the busy bytes of [lo, hi) into the cells it overlaps */
+static void mark_busy(long lo, long hi, long cell_bytes, int cells) {
+    while (lo < hi) {
+        long cell = lo / cell_bytes;
+        long cell_end = (cell + 1) * cell_bytes;
+        long end = hi < cell_end ? hi : cell_end;
+        if (cell < cells)
+            busy_in_cell[cell] += end - lo;
+        lo = end;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    mem_snap_hdr hdr;
+    mem_snap_rec rec;
+    int cols = 64;
+    int rows = 16;
+    long blocks = 0;
+    long busy_blocks = 0;
+    long busy_bytes = 0;
+    long free_bytes = 0;
+    long largest = 0;
+    long hist_count[BUCKETS];
+    long hist_bytes[BUCKETS];
+    int i;
+
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "usage: %s <snapshot> [columns [rows]]\n", argv[0]);
+        return 2;
+    }
+    if (argc > 2)
+        cols = atoi(argv[2]);
+    if (argc > 3)
+        rows = atoi(argv[3]);
+    if (cols <= 0 || cols > MAX_COLS || rows <= 0 || rows > MAX_ROWS) {
+        fprintf(stderr, "memsnap: map must be 1..%d columns, 1..%d rows\n",
+                MAX_COLS, MAX_ROWS);
+        return 2;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != MEM_SNAP_MAGIC) {
+        fprintf(stderr, "memsnap: %s is not a heap snapshot\n", argv[1]);
+        return 1;
+    }
+    if (hdr.version != MEM_SNAP_VERSION) {
+        fprintf(stderr, "memsnap: unsupported snapshot version %u\n",
+                hdr.version);
+        return 1;
+    }
+
+    int cells = cols * rows;
+    long cell_bytes = ((long)hdr.heap_size + cells - 1) / cells;
+    if (cell_bytes == 0)
+        cell_bytes = 1;
+    memset(hist_count, 0, sizeof(hist_count));
+    memset(hist_bytes, 0, sizeof(hist_bytes));
+
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        long size = rec.size_status & ~7u;
+        blocks++;
+        if (rec.size_status & 1) {
+            busy_blocks++;
+            busy_bytes += size;
+            mark_busy(rec.offset, rec.offset + size, cell_bytes, cells);
+        } else {
+            int b = 0;
+            while (b < BUCKETS - 1 && (2L << b) <= size)
+                b++;
+            hist_count[b]++;
+            hist_bytes[b] += size;
+            free_bytes += size;
+            if (size > largest)
+                largest = size;
+        }
+    }
+    fclose(f);
+
+    printf("heap size      %u bytes\n", hdr.heap_size);
+    printf("blocks         %ld (%ld busy, %ld free)\n", blocks, busy_blocks,
+           blocks - busy_blocks);
+    printf("busy bytes     %ld\n", busy_bytes);
+    printf("free bytes     %ld\n", free_bytes);
+    printf("largest free   %ld\n", largest);
+    printf("fragmentation  %.3f (1 - largest free / free bytes)\n",
+           free_bytes ? 1.0 - (double)largest / free_bytes : 0.0);
+
+    printf("\nmap, %ld bytes per cell ('#' busy, '.' free, '+' mixed)\n",
+           cell_bytes);
+    for (i = 0; i < cells; i++) {
+        long span = cell_bytes;
+        if ((long)(i + 1) * cell_bytes > (long)hdr.heap_size)
+            span = hdr.heap_size - (long)i * cell_bytes;
+        if (span <= 0)
+            putchar(' ');
+        else if (busy_in_cell[i] == 0)
+            putchar('.');
+        else if (busy_in_cell[i] >= span)
+            putchar('#');
+        else
+            putchar('+');
+        if (i % cols == cols - 1)
+            putchar('\n');
+    }
+
+    printf("\nfree block sizes\n");
+    long most = 0;
+    for (i = 0; i < BUCKETS; i++)
+        if (hist_count[i] > most)
+            most = hist_count[i];
+    for (i = 0; i < BUCKETS; i++) {
+        int bar;
+        if (hist_count[i] == 0)
+            continue;
+        printf("%10ld - %-10ld %6ld blocks %10ld bytes  ", 1L << i,
+               (2L << i) - 1, hist_count[i], hist_bytes[i]);
+        for (bar = 0; bar < hist_count[i] * 40 / most; bar++)
+            putchar('*');
+        putchar('\n');
+    }
+    return 0;
+}